@@ -0,0 +1,114 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <iostream>
+
+#include "pybind11/pybind11.h"
+
+#include "xhandles.hpp"
+#include "xbenchmark.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt_benchmark
+{
+    // Each case reproduces the module and attribute lookups done by one
+    // request before and after the introduction of the handle registry.
+    void run_handles_benchmarks()
+    {
+        auto& handles = xpyt::get_handles();
+        py::str code("x = 1\nx");
+        py::object path = handles.pathlib().attr(handles.path)("notebook.ipynb");
+        std::size_t sink = 0;
+
+        print_header("Module and attribute lookups per request");
+
+        double reference = measure([&]()
+        {
+            // input_redirection constructor and destructor
+            for (int i = 0; i < 2; ++i)
+            {
+                py::module builtins = py::module::import("builtins");
+                py::object input = builtins.attr("input");
+                builtins.attr("input") = input;
+                py::module getpass = py::module::import("getpass");
+                py::object getpass_func = getpass.attr("getpass");
+                getpass.attr("getpass") = getpass_func;
+            }
+        }, 10000);
+        double optimized = measure([&]()
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                const py::module& builtins = handles.builtins();
+                py::object input = builtins.attr(handles.input);
+                builtins.attr(handles.input) = input;
+                const py::module& getpass = handles.getpass();
+                py::object getpass_func = getpass.attr(handles.getpass_name);
+                getpass.attr(handles.getpass_name) = getpass_func;
+            }
+        }, 10000);
+        print_result("input redirection", reference, optimized);
+
+        reference = measure([&]()
+        {
+            py::module ast = py::module::import("ast");
+            py::module builtins = py::module::import("builtins");
+            py::object tree = ast.attr("parse")(code, "<string>", "exec");
+            sink += static_cast<std::size_t>(py::len(tree.attr("body")));
+            py::object expr = ast.attr("Expr");
+            py::object interactive = ast.attr("Interactive");
+            py::object compile = builtins.attr("compile");
+            sink += static_cast<std::size_t>(expr && interactive && compile);
+        }, 10000);
+        optimized = measure([&]()
+        {
+            const py::module& ast = handles.ast();
+            py::object tree = ast.attr(handles.parse)(code, "<string>", "exec");
+            sink += static_cast<std::size_t>(py::len(tree.attr("body")));
+            py::object expr = ast.attr(handles.expr);
+            py::object interactive = ast.attr(handles.interactive);
+            py::object compile = handles.builtins().attr(handles.compile);
+            sink += static_cast<std::size_t>(expr && interactive && compile);
+        }, 10000);
+        print_result("raw execute", reference, optimized);
+
+        reference = measure([&]()
+        {
+            py::module pathlib = py::module::import("pathlib");
+            sink += static_cast<std::size_t>(py::isinstance(path, py::make_tuple(pathlib.attr("Path"), pathlib.attr("PurePath"))));
+            py::module copy = py::module::import("copy");
+            sink += static_cast<std::size_t>(bool(copy.attr("deepcopy")));
+        }, 10000);
+        optimized = measure([&]()
+        {
+            const py::module& pathlib = handles.pathlib();
+            sink += static_cast<std::size_t>(py::isinstance(path, py::make_tuple(pathlib.attr(handles.path), pathlib.attr(handles.pure_path))));
+            sink += static_cast<std::size_t>(bool(handles.copy().attr(handles.deepcopy)));
+        }, 10000);
+        print_result("display object", reference, optimized);
+
+        reference = measure([&]()
+        {
+            sink += static_cast<std::size_t>(bool(py::module::import("traceback").attr("extract_tb")));
+        }, 10000);
+        optimized = measure([&]()
+        {
+            sink += static_cast<std::size_t>(bool(handles.traceback().attr(handles.extract_tb)));
+        }, 10000);
+        print_result("traceback frame", reference, optimized);
+
+        if (sink == 0)
+        {
+            std::cout << "Nothing was looked up" << std::endl;
+        }
+    }
+}
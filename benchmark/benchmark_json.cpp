@@ -0,0 +1,168 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11_json/pybind11_json.hpp"
+
+#include "pybind11/pybind11.h"
+#include "pybind11/eval.h"
+
+#include "xjson.hpp"
+#include "xbenchmark.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt_benchmark
+{
+    // Display bundles and messages as they are produced by common libraries
+    const char* bundles_code = R"(
+import base64
+import random
+
+random.seed(0)
+
+html_bundle = (
+    {
+        "text/plain": "<pandas.DataFrame 100 rows x 5 columns>",
+        "text/html": "<table>" + "".join(
+            "<tr>" + "".join("<td>{}</td>".format(random.random()) for _ in range(5)) + "</tr>"
+            for _ in range(100)
+        ) + "</table>",
+    },
+    {"text/html": {"isolated": False}},
+)
+
+png_bundle = (
+    {
+        "text/plain": "<Figure size 640x480 with 1 Axes>",
+        "image/png": base64.b64encode(random.randbytes(300000)).decode("ascii"),
+    },
+    {"image/png": {"width": 640, "height": 480}},
+)
+
+png_bytes_bundle = (
+    {
+        "text/plain": "<Figure size 640x480 with 1 Axes>",
+        "image/png": random.randbytes(3000000),
+    },
+    {"image/png": {"width": 640, "height": 480}},
+)
+
+json_bundle = (
+    {
+        "application/json": [
+            {"x": i, "y": random.random(), "label": "point {}".format(i), "visible": i % 2 == 0}
+            for i in range(1000)
+        ],
+        "text/plain": "<list of 1000 points>",
+    },
+    {},
+)
+
+widget_update = {
+    "method": "update",
+    "state": {
+        "value": 42.5,
+        "description": "Frequency",
+        "layout": "IPY_MODEL_3b5b5e0f1e0a4b2c9d8e7f6a5b4c3d2e",
+        "disabled": False,
+        "continuous_update": True,
+        "readout_format": ".2f",
+        "min": 0,
+        "max": 100,
+        "step": 0.1,
+    },
+    "buffer_paths": [],
+}
+
+bundles = {
+    "html table bundle": html_bundle,
+    "png image bundle": png_bundle,
+    "raw png bytes bundle": png_bytes_bundle,
+    "json data bundle": json_bundle,
+    "widget state update": (widget_update, {}),
+}
+)";
+
+    void run_json_benchmarks()
+    {
+        py::dict scope;
+        py::exec(bundles_code, scope);
+        py::dict bundles = scope["bundles"];
+
+        std::size_t sink = 0;
+
+        print_header("Python object to json");
+        for (auto item : bundles)
+        {
+            std::string name = py::str(item.first);
+            py::tuple bundle = py::reinterpret_borrow<py::tuple>(item.second);
+            py::object data = bundle[0];
+            py::object metadata = bundle[1];
+
+            if (xpyt::pyobj_to_json(data) != nl::json(data))
+            {
+                std::cerr << "Mismatch in the conversion of " << name << std::endl;
+            }
+
+            double reference = measure([&]()
+            {
+                nl::json cpp_data = data;
+                nl::json cpp_metadata = metadata;
+                sink += cpp_data.size() + cpp_metadata.size();
+            }, 200);
+            double optimized = measure([&]()
+            {
+                nl::json cpp_data = xpyt::pyobj_to_json(data);
+                nl::json cpp_metadata = xpyt::pyobj_to_json(metadata);
+                sink += cpp_data.size() + cpp_metadata.size();
+            }, 200);
+            print_result(name, reference, optimized);
+        }
+
+        print_header("json to Python object");
+        for (auto item : bundles)
+        {
+            std::string name = py::str(item.first);
+            py::tuple bundle = py::reinterpret_borrow<py::tuple>(item.second);
+            nl::json data = bundle[0];
+
+            if (!xpyt::json_to_pyobj(data).equal(data.get<py::object>()))
+            {
+                std::cerr << "Mismatch in the conversion of " << name << std::endl;
+            }
+
+            double reference = measure([&]()
+            {
+                py::object obj = data.get<py::object>();
+                sink += static_cast<std::size_t>(py::len(obj));
+            }, 200);
+            double optimized = measure([&]()
+            {
+                py::object obj = xpyt::json_to_pyobj(data);
+                sink += static_cast<std::size_t>(py::len(obj));
+            }, 200);
+            print_result(name, reference, optimized);
+        }
+
+        if (sink == 0)
+        {
+            std::cout << "Nothing was converted" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#include "pybind11/pybind11.h"
+#include "pybind11/eval.h"
+
+#include "xsvg.hpp"
+#include "xbenchmark.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt_benchmark
+{
+    // Vector plots shaped like the output of matplotlib's SVG backend
+    const char* plots_code = R"(
+import random
+
+random.seed(0)
+
+def make_plot(n_paths):
+    paths = "".join(
+        '  <path d="M {:.3f} {:.3f} L {:.3f} {:.3f}" clip-path="url(#p0)" '
+        'style="fill: none; stroke: #1f77b4; stroke-width: 1.5"/>\n'.format(
+            random.random() * 460, random.random() * 345, random.random() * 460, random.random() * 345
+        )
+        for _ in range(n_paths)
+    )
+    return (
+        '<?xml version="1.0" encoding="utf-8" standalone="no"?>\n'
+        '<!DOCTYPE svg PUBLIC "-//W3C//DTD SVG 1.1//EN"\n'
+        '  "http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd">\n'
+        '<svg xmlns:xlink="http://www.w3.org/1999/xlink" width="460pt" height="345pt" '
+        'viewBox="0 0 460 345" xmlns="http://www.w3.org/2000/svg" version="1.1">\n'
+        ' <metadata><!-- created by a plotting library --></metadata>\n'
+        ' <g id="figure_1">\n' + paths + ' </g>\n'
+        ' <defs><clipPath id="p0"><rect x="57" y="41" width="357" height="266"/></clipPath></defs>\n'
+        '</svg>\n'
+    ).encode("utf-8")
+
+plots = {
+    "line plot (1k paths)": make_plot(1000),
+    "scatter plot (20k paths)": make_plot(20000),
+    "dense plot (100k paths)": make_plot(100000),
+}
+)";
+
+    void run_svg_benchmarks()
+    {
+        py::dict scope;
+        py::exec(plots_code, scope);
+        py::dict plots = scope["plots"];
+        py::module minidom = py::module::import("xml.dom.minidom");
+
+        std::size_t sink = 0;
+
+        print_header("SVG root element extraction");
+        for (auto item : plots)
+        {
+            std::string name = py::str(item.first);
+            py::bytes plot = py::reinterpret_borrow<py::bytes>(item.second);
+            std::string content = plot;
+
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            if (!xpyt::find_svg_element(content.data(), content.size(), begin, end))
+            {
+                std::cerr << "No svg element found in " << name << std::endl;
+                continue;
+            }
+
+            double reference = measure([&]()
+            {
+                py::list found = minidom.attr("parseString")(plot).attr("getElementsByTagName")("svg");
+                py::str svg = found[0].attr("toxml")();
+                sink += static_cast<std::size_t>(py::len(svg));
+            }, 5);
+            double optimized = measure([&]()
+            {
+                char* buffer = nullptr;
+                Py_ssize_t size = 0;
+                PyBytes_AsStringAndSize(plot.ptr(), &buffer, &size);
+                std::size_t svg_begin = 0;
+                std::size_t svg_end = 0;
+                xpyt::find_svg_element(buffer, static_cast<std::size_t>(size), svg_begin, svg_end);
+                py::str svg = py::reinterpret_steal<py::str>(
+                    PyUnicode_DecodeUTF8(buffer + svg_begin, static_cast<Py_ssize_t>(svg_end - svg_begin), nullptr));
+                sink += static_cast<std::size_t>(py::len(svg));
+            }, 5);
+            print_result(name, reference, optimized);
+        }
+
+        if (sink == 0)
+        {
+            std::cout << "Nothing was extracted" << std::endl;
+        }
+    }
+}
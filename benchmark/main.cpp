@@ -0,0 +1,26 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "pybind11/embed.h"
+
+#include "xbenchmark.hpp"
+
+namespace py = pybind11;
+
+int main()
+{
+    py::scoped_interpreter guard;
+
+    xpyt_benchmark::run_handles_benchmarks();
+    xpyt_benchmark::run_json_benchmarks();
+    xpyt_benchmark::run_svg_benchmarks();
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_BENCHMARK_HPP
+#define XPYT_BENCHMARK_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace xpyt_benchmark
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // Returns the mean duration of a call to f in microseconds,
+    // after a warm-up call.
+    template <class F>
+    double measure(F&& f, std::size_t iterations)
+    {
+        f();
+        auto start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            f();
+        }
+        auto end = clock_type::now();
+        return std::chrono::duration<double, std::micro>(end - start).count() / static_cast<double>(iterations);
+    }
+
+    inline void print_header(const std::string& title)
+    {
+        std::cout << "\n" << title << "\n"
+                  << std::left << std::setw(40) << "case"
+                  << std::right << std::setw(16) << "reference (us)"
+                  << std::setw(16) << "xeus-python (us)"
+                  << std::setw(10) << "speedup" << "\n";
+    }
+
+    inline void print_result(const std::string& name, double reference, double optimized)
+    {
+        std::cout << std::left << std::setw(40) << name
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(16) << reference
+                  << std::setw(16) << optimized
+                  << std::setw(9) << reference / optimized << "x\n";
+    }
+
+    void run_handles_benchmarks();
+    void run_json_benchmarks();
+    void run_svg_benchmarks();
+}
+
+#endif
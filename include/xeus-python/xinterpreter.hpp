@@ -100,6 +100,14 @@ namespace xpyt
     private:
 
         virtual void instanciate_ipython_shell();
+
+        void install_profile_hooks();
+        void remove_profile_hooks();
+
+        // List of tuples (owner, name, own_attribute, original) recording
+        // the attributes replaced by install_profile_hooks, null when the
+        // hooks are not installed
+        py::object m_profile_hooks;
     };
 }
 
@@ -0,0 +1,169 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_OPTIONS_HPP
+#define XPYT_OPTIONS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "xeus_python_config.hpp"
+
+namespace xpyt
+{
+    /**
+     * Options of the sys.stdout and sys.stderr replacements.
+     *
+     * When buffer_size is not zero, the output written by Python is
+     * accumulated and sent to the frontend when the buffer exceeds
+     * buffer_size bytes, when flush_interval has elapsed since the first
+     * buffered write, when the stream is explicitly flushed, or at the
+     * end of the execution of a cell.
+     *
+     * When capture_fd is true, the file descriptors 1 and 2 are also
+     * redirected, so that the output of native code and child processes
+     * is sent to the frontend (POSIX only).
+     *
+     * When max_cell_bytes or max_cell_messages is not zero, the stream
+     * output of a cell exceeding that many bytes or messages is written
+     * to a spill file instead, and a summary is sent at the end of the
+     * cell.
+     *
+     * When compact_output is true, the parts of the output that are
+     * overwritten by carriage returns (progress bars) are removed before
+     * being sent.
+     */
+    struct XEUS_PYTHON_API xstream_options
+    {
+        std::size_t buffer_size = 0;
+        std::chrono::milliseconds flush_interval = std::chrono::milliseconds(100);
+        bool capture_fd = false;
+        std::size_t max_cell_bytes = 0;
+        std::size_t max_cell_messages = 0;
+        bool compact_output = true;
+    };
+
+    /**
+     * Options of the display_data and update_display_data messages.
+     *
+     * When deduplicate_updates is true, an update of a display identical
+     * to the last bundle sent for that display id is not sent.
+     *
+     * When update_interval is not zero, a display id is not updated more
+     * than once per update_interval, and a clear_output(wait=True) is not
+     * sent more than once per update_interval: the intermediate updates
+     * and frames are dropped, the latest one being sent when the interval
+     * has elapsed or at the end of the execution of the cell.
+     *
+     * When store_threshold is not zero, the entries of the display bundles
+     * larger than store_threshold bytes are written to a content-addressed
+     * store in store_directory, and replaced in the messages by references
+     * and previews. The frontend fetches them through a comm. An empty
+     * store_directory stands for a directory of the Jupyter runtime
+     * directory.
+     */
+    struct XEUS_PYTHON_API xdisplay_options
+    {
+        bool deduplicate_updates = true;
+        std::chrono::milliseconds update_interval = std::chrono::milliseconds(0);
+        std::size_t store_threshold = 0;
+        std::string store_directory;
+    };
+
+    /**
+     * Options of the Comm objects.
+     *
+     * When coalesce_updates is true, the widget state updates sent by a
+     * comm are merged key by key, the latest value winning, and sent when
+     * coalesce_interval has elapsed since the first merged update, before
+     * any other output, or at the end of the execution of the cell. This
+     * is the default value of the coalesce_updates property of the Comm
+     * objects.
+     */
+    struct XEUS_PYTHON_API xcomm_options
+    {
+        bool coalesce_updates = false;
+        std::chrono::milliseconds coalesce_interval = std::chrono::milliseconds(50);
+    };
+
+    /**
+     * Options of the execution of the cells.
+     *
+     * When profile_cells is true, the time spent in each phase of the
+     * execution of a cell is reported in the profile field of the execute
+     * replies. This is the default value of the profile_cells property of
+     * the kernel object.
+     */
+    struct XEUS_PYTHON_API xexecution_options
+    {
+        bool profile_cells = false;
+    };
+
+    /**
+     * Options of the metrics of the kernel.
+     *
+     * When file is not empty, the counters and latency histograms of the
+     * requests and publications are written to it in the Prometheus text
+     * format every export_interval. Shorter intervals than
+     * min_metrics_export_interval are raised to it.
+     */
+    struct XEUS_PYTHON_API xmetrics_options
+    {
+        std::string file;
+        std::chrono::milliseconds export_interval = std::chrono::milliseconds(10000);
+    };
+
+    constexpr std::chrono::milliseconds min_metrics_export_interval = std::chrono::milliseconds(100);
+
+    /**
+     * Options of the completion.
+     *
+     * When native_index is true, the names of the user namespace and their
+     * attributes are indexed after each execution, and the completion of a
+     * name or of an attribute of a name is answered from that index without
+     * acquiring the GIL.
+     */
+    struct XEUS_PYTHON_API xcompletion_options
+    {
+        bool native_index = false;
+    };
+
+    XEUS_PYTHON_API xstream_options& get_stream_options();
+    XEUS_PYTHON_API xdisplay_options& get_display_options();
+    XEUS_PYTHON_API xcomm_options& get_comm_options();
+    XEUS_PYTHON_API xexecution_options& get_execution_options();
+    XEUS_PYTHON_API xmetrics_options& get_metrics_options();
+    XEUS_PYTHON_API xcompletion_options& get_completion_options();
+
+    // Extracts the kernel options from the command line:
+    //   --stream-buffer-size <bytes>
+    //   --stream-flush-interval <milliseconds>
+    //   --capture-fd
+    //   --stream-max-cell-bytes <bytes>
+    //   --stream-max-cell-messages <count>
+    //   --no-stream-compaction
+    //   --no-display-deduplication
+    //   --display-update-interval <milliseconds>
+    //   --display-store-threshold <bytes>
+    //   --display-store-dir <path>
+    //   --coalesce-comm-updates
+    //   --comm-coalesce-interval <milliseconds>
+    //   --profile-cells
+    //   --metrics-file <path>
+    //   --metrics-interval <milliseconds>
+    //   --completion-index
+    // Throws std::invalid_argument when the value of an option is not a
+    // valid non-negative integer.
+    XEUS_PYTHON_API
+    void extract_kernel_options(int argc, char* argv[]);
+}
+
+#endif
@@ -10,6 +10,7 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <utility>
 #include <signal.h>
@@ -36,6 +37,7 @@
 #include "xeus-python/xdebugger.hpp"
 #include "xeus-python/xpaths.hpp"
 #include "xeus-python/xeus_python_config.hpp"
+#include "xeus-python/xoptions.hpp"
 #include "xeus-python/xutils.hpp"
 
 namespace py = pybind11;
@@ -105,6 +107,15 @@ int main(int argc, char* argv[])
 
     // Instantiating the xeus xinterpreter
     bool raw_mode = xpyt::extract_option("-r", "--raw", argc, argv);
+    try
+    {
+        xpyt::extract_kernel_options(argc, argv);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << "xpython: " << e.what() << std::endl;
+        return 1;
+    }
     using interpreter_ptr = std::unique_ptr<xeus::xinterpreter>;
     interpreter_ptr interpreter;
     if (raw_mode)
@@ -0,0 +1,121 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+
+#include "xbase64.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(XPYT_EMSCRIPTEN_WASM_BUILD)
+#define XPYT_BASE64_SSSE3
+#include <immintrin.h>
+#endif
+
+namespace xpyt
+{
+    namespace
+    {
+        const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        // Encodes the bytes that do not fill a SIMD block, and the padding
+        void encode_scalar(const unsigned char* in, std::size_t size, char* out)
+        {
+            std::size_t i = 0;
+            for (; i + 3 <= size; i += 3)
+            {
+                std::uint32_t block = (std::uint32_t(in[i]) << 16) | (std::uint32_t(in[i + 1]) << 8) | std::uint32_t(in[i + 2]);
+                *out++ = base64_alphabet[(block >> 18) & 0x3f];
+                *out++ = base64_alphabet[(block >> 12) & 0x3f];
+                *out++ = base64_alphabet[(block >> 6) & 0x3f];
+                *out++ = base64_alphabet[block & 0x3f];
+            }
+
+            std::size_t remaining = size - i;
+            if (remaining != 0)
+            {
+                std::uint32_t block = std::uint32_t(in[i]) << 16;
+                if (remaining == 2)
+                {
+                    block |= std::uint32_t(in[i + 1]) << 8;
+                }
+                *out++ = base64_alphabet[(block >> 18) & 0x3f];
+                *out++ = base64_alphabet[(block >> 12) & 0x3f];
+                *out++ = remaining == 2 ? base64_alphabet[(block >> 6) & 0x3f] : '=';
+                *out++ = '=';
+            }
+        }
+
+#ifdef XPYT_BASE64_SSSE3
+        // Encodes 12 bytes into 16 characters per iteration. Each iteration
+        // loads 16 bytes, so the loop stops while 16 bytes are left.
+        // Returns the number of bytes encoded.
+        __attribute__((target("ssse3")))
+        std::size_t encode_ssse3(const unsigned char* in, std::size_t size, char* out)
+        {
+            // Moves the 3 bytes of each group into a 32-bit lane: b1 b0 b2 b1
+            const __m128i shuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+            // Offsets from the 6-bit indices to the characters, selected by range
+            const __m128i offsets = _mm_setr_epi8(
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+            std::size_t i = 0;
+            for (; i + 16 <= size; i += 12)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                bytes = _mm_shuffle_epi8(bytes, shuffle);
+
+                // Extracts the four 6-bit indices of each lane into its four bytes
+                __m128i t0 = _mm_and_si128(bytes, _mm_set1_epi32(0x0fc0fc00));
+                __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+                __m128i t2 = _mm_and_si128(bytes, _mm_set1_epi32(0x003f03f0));
+                __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+                __m128i indices = _mm_or_si128(t1, t3);
+
+                // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+                __m128i ranges = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+                __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+                ranges = _mm_or_si128(ranges, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+                __m128i chars = _mm_add_epi8(_mm_shuffle_epi8(offsets, ranges), indices);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+                out += 16;
+            }
+            return i;
+        }
+
+        bool has_ssse3()
+        {
+            static const bool supported = __builtin_cpu_supports("ssse3");
+            return supported;
+        }
+#endif
+    }
+
+    std::size_t base64_encoded_size(std::size_t size)
+    {
+        return (size + 2) / 3 * 4;
+    }
+
+    void base64_encode(const char* data, std::size_t size, char* out)
+    {
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+#ifdef XPYT_BASE64_SSSE3
+        if (has_ssse3())
+        {
+            std::size_t encoded = encode_ssse3(in, size, out);
+            in += encoded;
+            size -= encoded;
+            out += encoded / 3 * 4;
+        }
+#endif
+        encode_scalar(in, size, out);
+    }
+}
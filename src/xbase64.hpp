@@ -0,0 +1,30 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_BASE64_HPP
+#define XPYT_BASE64_HPP
+
+#include <cstddef>
+
+namespace xpyt
+{
+    // Size of the base64 encoding (with padding) of size bytes
+    std::size_t base64_encoded_size(std::size_t size);
+
+    /**
+     * Encodes size bytes of data in standard base64 with padding, without
+     * line breaks, into out, which must have room for base64_encoded_size(size)
+     * characters. On x86, an SSSE3 implementation is selected at runtime
+     * when the processor supports it.
+     */
+    void base64_encode(const char* data, std::size_t size, char* out);
+}
+
+#endif
@@ -0,0 +1,91 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include "pybind11/pybind11.h"
+
+#include "xcode_cache.hpp"
+#include "xhandles.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    /******************************
+     * xcode_cache implementation *
+     ******************************/
+
+    namespace
+    {
+        constexpr std::size_t code_cache_max_size = 512;
+    }
+
+    xcompiled_cell xcode_cache::get(const std::string& code, const std::string& filename)
+    {
+        auto it = m_entries.find(filename);
+        if (it != m_entries.end() && it->second.m_code == code)
+        {
+            return it->second.m_cell;
+        }
+
+        xcompiled_cell cell = compile_cell(code, filename);
+        if (m_entries.size() >= code_cache_max_size)
+        {
+            m_entries.clear();
+        }
+        m_entries[filename] = xentry{ code, cell };
+        return cell;
+    }
+
+    void xcode_cache::clear()
+    {
+        m_entries.clear();
+    }
+
+    xcompiled_cell xcode_cache::compile_cell(const std::string& code, const std::string& filename) const
+    {
+        auto& handles = get_handles();
+        const py::module& ast = handles.ast();
+        py::object compile = handles.builtins().attr(handles.compile);
+
+        py::object code_ast = ast.attr(handles.parse)(code, "<string>", "exec");
+        py::list expressions = code_ast.attr("body");
+
+        // If the last statement is an expression, we compile it separately
+        // in an interactive mode (This will trigger the display hook)
+        py::list interactive_nodes;
+        std::size_t size = py::len(expressions);
+        if (size != 0 && py::isinstance(expressions[size - 1], ast.attr(handles.expr)))
+        {
+            interactive_nodes.append(expressions.attr("pop")());
+        }
+
+        xcompiled_cell cell;
+        cell.m_body = compile(code_ast, filename, "exec");
+        cell.m_last_expression = py::none();
+        if (py::len(interactive_nodes) != 0)
+        {
+            py::object interactive_ast = ast.attr(handles.interactive)(interactive_nodes);
+            cell.m_last_expression = compile(interactive_ast, filename, "single");
+        }
+        return cell;
+    }
+
+    // Leaked so that the code objects are not released after the
+    // interpreter is finalized
+    xcode_cache& get_code_cache()
+    {
+        static xcode_cache* cache = new xcode_cache();
+        return *cache;
+    }
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_CODE_CACHE_HPP
+#define XPYT_CODE_CACHE_HPP
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    /**
+     * Code objects of a cell. When the last statement of the cell is an
+     * expression, it is compiled apart in the "single" mode so that its
+     * value goes through the display hook, and m_last_expression is not
+     * None.
+     */
+    struct xcompiled_cell
+    {
+        py::object m_body;
+        py::object m_last_expression;
+    };
+
+    /***************************
+     * xcode_cache declaration *
+     ***************************/
+
+    /**
+     * Cache of the compiled cells of the raw mode, keyed by the name of
+     * the cell file, which is derived from a hash of its code. The code is
+     * compared on lookup, so that a collision of the hashes compiles the
+     * cell again. Must be accessed with the GIL held.
+     */
+    class xcode_cache
+    {
+    public:
+
+        // Returns the code objects of the cell, compiling it on a miss.
+        // Raises the SyntaxError of the cell.
+        xcompiled_cell get(const std::string& code, const std::string& filename);
+
+        void clear();
+
+    private:
+
+        struct xentry
+        {
+            std::string m_code;
+            xcompiled_cell m_cell;
+        };
+
+        xcompiled_cell compile_cell(const std::string& code, const std::string& filename) const;
+
+        std::unordered_map<std::string, xentry> m_entries;
+    };
+
+    xcode_cache& get_code_cache();
+}
+
+#endif
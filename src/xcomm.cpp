@@ -8,8 +8,15 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
+
 #include "nlohmann/json.hpp"
 
 #include "xeus/xcomm.hpp"
@@ -18,13 +25,17 @@
 #include "pybind11_json/pybind11_json.hpp"
 
 #include "pybind11/pybind11.h"
-#include "pybind11/functional.h"
 #include "pybind11/eval.h"
 
+#include "xeus-python/xoptions.hpp"
 #include "xeus-python/xutils.hpp"
 
 #include "xcomm.hpp"
+#include "xcompletion_cache.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
+#include "xpublisher.hpp"
+#include "xstream.hpp"
 
 namespace py = pybind11;
 namespace nl = nlohmann;
@@ -33,23 +44,258 @@ using namespace pybind11::literals;
 namespace xpyt
 {
 
+    /*******************************
+     * xcomm_updates declaration *
+     *******************************/
+
+    // Widget state updates waiting to be sent, merged per comm.
+    class xcomm_updates
+    {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        void add(xeus::xcomm* comm, nl::json metadata, nl::json data, xeus::buffer_sequence buffers);
+        void flush();
+        void flush_due();
+        bool empty() const;
+
+    private:
+
+        struct xpending_update
+        {
+            xeus::xcomm* p_comm;
+            nl::json m_metadata;
+            nl::json m_data;
+            xeus::buffer_sequence m_buffers;
+            clock_type::time_point m_start;
+        };
+
+        static void merge(xpending_update& pending, nl::json metadata, nl::json data, xeus::buffer_sequence buffers);
+
+        std::vector<xpending_update> m_updates;
+        std::atomic<bool> m_has_updates{false};
+        std::mutex m_mutex;
+    };
+
+    /**********************************
+     * xcomm_updates implementation *
+     **********************************/
+
+    void xcomm_updates::add(xeus::xcomm* comm, nl::json metadata, nl::json data, xeus::buffer_sequence buffers)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_updates.begin(), m_updates.end(),
+                               [comm](const xpending_update& pending) { return pending.p_comm == comm; });
+
+        if (it != m_updates.end() && clock_type::now() - it->m_start >= get_comm_options().coalesce_interval)
+        {
+            lock.unlock();
+            flush();
+            lock.lock();
+            it = m_updates.end();
+        }
+
+        if (it == m_updates.end())
+        {
+            // The output written before this update must be sent first
+            flush_streams();
+            m_updates.push_back({ comm, std::move(metadata), std::move(data), std::move(buffers), clock_type::now() });
+            if (!m_has_updates.exchange(true))
+            {
+                // The timer sends the updates if nothing else does before
+                lock.unlock();
+                get_publisher().notify_comm_update();
+            }
+        }
+        else
+        {
+            merge(*it, std::move(metadata), std::move(data), std::move(buffers));
+        }
+    }
+
+    void xcomm_updates::flush()
+    {
+        if (!m_has_updates.load())
+        {
+            return;
+        }
+
+        std::vector<xpending_update> updates;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::swap(updates, m_updates);
+            m_has_updates.store(false);
+        }
+
+        get_publisher().synchronize();
+        for (xpending_update& pending : updates)
+        {
+            pending.p_comm->send(std::move(pending.m_metadata), std::move(pending.m_data), std::move(pending.m_buffers));
+        }
+    }
+
+    // The updates are sent together, so that the updates of the different
+    // comms keep their order
+    void xcomm_updates::flush_due()
+    {
+        if (!m_has_updates.load())
+        {
+            return;
+        }
+
+        bool due = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto now = clock_type::now();
+            due = std::any_of(m_updates.cbegin(), m_updates.cend(), [now](const xpending_update& pending)
+            {
+                return now - pending.m_start >= get_comm_options().coalesce_interval;
+            });
+        }
+
+        if (due)
+        {
+            flush();
+        }
+    }
+
+    bool xcomm_updates::empty() const
+    {
+        return !m_has_updates.load();
+    }
+
+    // The latest value of each key of the state wins. The buffers of the
+    // pending update whose key is overwritten are dropped.
+    void xcomm_updates::merge(xpending_update& pending, nl::json metadata, nl::json data, xeus::buffer_sequence buffers)
+    {
+        nl::json& state = pending.m_data["state"];
+        const nl::json& new_state = data["state"];
+
+        nl::json buffer_paths = nl::json::array();
+        xeus::buffer_sequence merged_buffers;
+        auto old_paths = pending.m_data.find("buffer_paths");
+        if (old_paths != pending.m_data.end())
+        {
+            for (std::size_t i = 0; i < old_paths->size() && i < pending.m_buffers.size(); ++i)
+            {
+                const nl::json& path = (*old_paths)[i];
+                if (!path.empty() && path[0].is_string() && new_state.contains(path[0].get<std::string>()))
+                {
+                    continue;
+                }
+                buffer_paths.push_back(path);
+                merged_buffers.push_back(std::move(pending.m_buffers[i]));
+            }
+        }
+
+        auto new_paths = data.find("buffer_paths");
+        if (new_paths != data.end())
+        {
+            for (std::size_t i = 0; i < new_paths->size() && i < buffers.size(); ++i)
+            {
+                buffer_paths.push_back((*new_paths)[i]);
+                merged_buffers.push_back(std::move(buffers[i]));
+            }
+        }
+
+        state.update(new_state);
+        if (old_paths != pending.m_data.end() || new_paths != data.end())
+        {
+            pending.m_data["buffer_paths"] = std::move(buffer_paths);
+        }
+        pending.m_buffers = std::move(merged_buffers);
+        pending.m_metadata = std::move(metadata);
+    }
+
+    xcomm_updates& get_comm_updates()
+    {
+        static xcomm_updates updates;
+        return updates;
+    }
+
+    void flush_comm_updates()
+    {
+        get_comm_updates().flush();
+    }
+
+    void flush_due_comm_updates()
+    {
+        get_comm_updates().flush_due();
+    }
+
+    bool has_comm_updates()
+    {
+        return !get_comm_updates().empty();
+    }
+
+    // Only the "update" messages of the widgets protocol are coalesced
+    bool is_state_update(const py::object& data)
+    {
+        if (!py::isinstance<py::dict>(data))
+        {
+            return false;
+        }
+        py::dict dict = data;
+        if (!dict.contains("method") || !dict.contains("state"))
+        {
+            return false;
+        }
+        py::object method = dict["method"];
+        return py::isinstance<py::str>(method) && method.cast<std::string>() == "update" &&
+               py::isinstance<py::dict>(dict["state"]);
+    }
+
+    // The JSON content of the comm messages is already parsed when they
+    // are received, only their binary buffers are measured
+    std::size_t buffers_size(const xeus::xmessage& msg)
+    {
+        std::size_t size = 0;
+        for (const auto& buffer : msg.buffers())
+        {
+            size += buffer.size();
+        }
+        return size;
+    }
+
+    // Python callback shared by the copies of a C++ comm callback, which
+    // can then be copied and destroyed by xeus without the GIL. The GIL is
+    // acquired once per message to convert it and call the callback, and
+    // when the last copy is destroyed.
+    using shared_pycallback = std::shared_ptr<py::object>;
+
+    shared_pycallback make_shared_pycallback(const py::object& callback)
+    {
+        return shared_pycallback(new py::object(callback), [](py::object* ptr)
+        {
+            XPYT_HOLDING_GIL(delete ptr)
+        });
+    }
+
     /************************
      * xcomm implementation *
      ************************/
 
     xcomm::xcomm(const py::object& target_name, const py::object& data, const py::object& metadata, const py::object& buffers, const py::kwargs& kwargs)
         : m_comm(target(target_name), id(kwargs))
+        , m_coalesce_updates(get_comm_options().coalesce_updates)
     {
-        m_comm.open(metadata, data, pylist_to_cpp_buffers(buffers));
+        get_publisher().synchronize();
+        m_comm.open(pyobj_to_json(metadata), pyobj_to_json(data), pylist_to_cpp_buffers(buffers));
     }
 
     xcomm::xcomm(xeus::xcomm&& comm)
         : m_comm(std::move(comm))
+        , m_coalesce_updates(get_comm_options().coalesce_updates)
     {
     }
 
     xcomm::~xcomm()
     {
+        if (m_coalesce_updates)
+        {
+            flush_comm_updates();
+        }
     }
 
     std::string xcomm::comm_id() const
@@ -64,22 +310,44 @@ namespace xpyt
 
     void xcomm::close(const py::object& data, const py::object& metadata, const py::object& buffers)
     {
-        m_comm.close(metadata, data, pylist_to_cpp_buffers(buffers));
+        get_publisher().synchronize();
+        m_comm.close(pyobj_to_json(metadata), pyobj_to_json(data), pylist_to_cpp_buffers(buffers));
     }
 
     void xcomm::send(const py::object& data, const py::object& metadata, const py::object& buffers)
     {
-        m_comm.send(metadata, data, pylist_to_cpp_buffers(buffers));
+        if (m_coalesce_updates && is_state_update(data))
+        {
+            get_comm_updates().add(&m_comm, pyobj_to_json(metadata), pyobj_to_json(data), pylist_to_cpp_buffers(buffers));
+            return;
+        }
+
+        get_publisher().synchronize();
+        m_comm.send(pyobj_to_json(metadata), pyobj_to_json(data), pylist_to_cpp_buffers(buffers));
     }
 
-    void xcomm::on_msg(const python_callback_type& callback)
+    void xcomm::on_msg(const py::object& callback)
     {
-        m_comm.on_message(cpp_callback(callback));
+        m_comm.on_message(cpp_callback(callback, xrequest_kind::comm_msg));
     }
 
-    void xcomm::on_close(const python_callback_type& callback)
+    void xcomm::on_close(const py::object& callback)
     {
-        m_comm.on_close(cpp_callback(callback));
+        m_comm.on_close(cpp_callback(callback, xrequest_kind::comm_close));
+    }
+
+    bool xcomm::coalesce_updates() const
+    {
+        return m_coalesce_updates;
+    }
+
+    void xcomm::set_coalesce_updates(bool coalesce)
+    {
+        if (m_coalesce_updates && !coalesce)
+        {
+            flush_comm_updates();
+        }
+        m_coalesce_updates = coalesce;
     }
 
     xeus::xtarget* xcomm::target(const py::object& target_name) const
@@ -100,19 +368,35 @@ namespace xpyt
         }
     }
 
-    auto xcomm::cpp_callback(const python_callback_type& py_callback) const -> cpp_callback_type
+    auto xcomm::cpp_callback(const py::object& callback, xrequest_kind kind) const -> cpp_callback_type
     {
-        return [this, py_callback](const xeus::xmessage& msg)
+        shared_pycallback py_callback = make_shared_pycallback(callback);
+        return [py_callback, kind](const xeus::xmessage& msg)
         {
-            XPYT_HOLDING_GIL(py_callback(cppmessage_to_pymessage(msg)))
+            xrequest_metric metric(kind, buffers_size(msg));
+            XPYT_HOLDING_GIL(
+                // Widget callbacks can change the user namespace
+                get_completion_cache().invalidate();
+                xpymessage_scope scope(msg);
+                if (!py_callback->is_none())
+                {
+                    (*py_callback)(scope.message());
+                }
+            )
         };
     }
 
     void xcomm_manager::register_target(const py::str& target_name, const py::object& callback)
     {
-        auto target_callback = [callback] (xeus::xcomm&& comm, const xeus::xmessage& msg)
+        shared_pycallback py_callback = make_shared_pycallback(callback);
+        auto target_callback = [py_callback] (xeus::xcomm&& comm, const xeus::xmessage& msg)
         {
-            XPYT_HOLDING_GIL(callback(xcomm(std::move(comm)), cppmessage_to_pymessage(msg)));
+            xrequest_metric metric(xrequest_kind::comm_open, buffers_size(msg));
+            XPYT_HOLDING_GIL(
+                get_completion_cache().invalidate();
+                xpymessage_scope scope(msg);
+                (*py_callback)(xcomm(std::move(comm)), scope.message());
+            )
         };
 
         xeus::get_interpreter().comm_manager().register_comm_target(
@@ -138,7 +422,8 @@ namespace xpyt
             .def("on_msg", &xcomm::on_msg)
             .def("on_close", &xcomm::on_close)
             .def_property_readonly("comm_id", &xcomm::comm_id)
-            .def_property_readonly("kernel", &xcomm::kernel);
+            .def_property_readonly("kernel", &xcomm::kernel)
+            .def_property("coalesce_updates", &xcomm::coalesce_updates, &xcomm::set_coalesce_updates);
 
         py::class_<xcomm_manager>(comm_module, "CommManager")
             .def(py::init<>())
@@ -11,8 +11,15 @@
 #ifndef XPYT_COMM_HPP
 #define XPYT_COMM_HPP
 
+#include <functional>
+#include <string>
+
+#include "xeus/xcomm.hpp"
+
 #include "pybind11/pybind11.h"
 
+#include "xmetrics.hpp"
+
 namespace py = pybind11;
 
 namespace xpyt
@@ -21,7 +28,6 @@ namespace xpyt
     {
     public:
 
-        using python_callback_type = std::function<void(py::object)>;
         using cpp_callback_type = std::function<void(const xeus::xmessage&)>;
         using buffers_sequence = xeus::buffer_sequence;
 
@@ -35,16 +41,20 @@ namespace xpyt
 
         void close(const py::object& data, const py::object& metadata, const py::object& buffers);
         void send(const py::object& data, const py::object& metadata, const py::object& buffers);
-        void on_msg(const python_callback_type& callback);
-        void on_close(const python_callback_type& callback);
+        void on_msg(const py::object& callback);
+        void on_close(const py::object& callback);
+
+        bool coalesce_updates() const;
+        void set_coalesce_updates(bool coalesce);
 
     private:
 
         xeus::xtarget* target(const py::object& target_name) const;
         xeus::xguid id(const py::kwargs& kwargs) const;
-        cpp_callback_type cpp_callback(const python_callback_type& callback) const;
+        cpp_callback_type cpp_callback(const py::object& callback, xrequest_kind kind) const;
 
         xeus::xcomm m_comm;
+        bool m_coalesce_updates;
     };
 
     struct xcomm_manager
@@ -56,6 +66,18 @@ namespace xpyt
 
     py::module get_comm_module();
 
+    // Sends the widget state updates that have been coalesced so far.
+    // This must be called before publishing any other message so that
+    // the order of the outputs is preserved.
+    void flush_comm_updates();
+
+    // Sends the coalesced widget state updates if the coalescing interval
+    // has elapsed since the first of them. Must be called with the GIL held.
+    void flush_due_comm_updates();
+
+    // Can be called from any thread
+    bool has_comm_updates();
+
 }
 
 #endif
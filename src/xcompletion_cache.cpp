@@ -0,0 +1,178 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "xcompletion_cache.hpp"
+#include "xinternal_utils.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        bool is_identifier(const std::string& code, std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                if (!is_identifier_char(code[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        char to_lower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        // The cached matches are filtered the way the completer matched them
+        bool starts_with(const std::string& match, const std::string& prefix, xcompletion_case match_case)
+        {
+            if (match.size() < prefix.size())
+            {
+                return false;
+            }
+            if (match_case == xcompletion_case::sensitive)
+            {
+                return match.compare(0, prefix.size(), prefix) == 0;
+            }
+            for (std::size_t i = 0; i < prefix.size(); ++i)
+            {
+                if (to_lower(match[i]) != to_lower(prefix[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    /************************************
+     * xcompletion_cache implementation *
+     ************************************/
+
+    bool xcompletion_cache::get(const std::string& code, int cursor_pos, nl::json& reply) const
+    {
+        if (!m_valid || cursor_pos < m_cursor_pos)
+        {
+            return false;
+        }
+
+        std::size_t offset = utf8_offset(code, cursor_pos);
+        if (offset == std::string::npos || offset < m_cursor_offset)
+        {
+            return false;
+        }
+
+        // The code around the completed token must not have changed, and
+        // the new characters must extend the token
+        if (code.compare(0, m_cursor_offset, m_code, 0, m_cursor_offset) != 0
+            || code.compare(offset, std::string::npos, m_code, m_cursor_offset, std::string::npos) != 0
+            || !is_identifier(code, m_cursor_offset, offset))
+        {
+            return false;
+        }
+
+        std::string token = code.substr(m_start_offset, offset - m_start_offset);
+        if (!token.empty() && token[0] == '_')
+        {
+            return false;
+        }
+
+        nl::json matches = nl::json::array();
+        for (const auto& match : m_matches)
+        {
+            if (starts_with(match.get_ref<const std::string&>(), token, m_match_case))
+            {
+                matches.push_back(match);
+            }
+        }
+
+        reply["matches"] = std::move(matches);
+        reply["cursor_start"] = m_cursor_start;
+        reply["cursor_end"] = cursor_pos;
+        reply["metadata"] = nl::json::object();
+        reply["status"] = "ok";
+        return true;
+    }
+
+    void xcompletion_cache::put(const std::string& code,
+                                int cursor_pos,
+                                const nl::json& reply,
+                                xcompletion_case match_case,
+                                bool lists_all_attributes)
+    {
+        m_valid = false;
+
+        int cursor_start = reply["cursor_start"].get<int>();
+        int cursor_end = reply["cursor_end"].get<int>();
+        if (cursor_end != cursor_pos || cursor_start > cursor_pos)
+        {
+            return;
+        }
+
+        std::size_t cursor_offset = utf8_offset(code, cursor_pos);
+        std::size_t start_offset = utf8_offset(code, cursor_start);
+        if (cursor_offset == std::string::npos || start_offset == std::string::npos)
+        {
+            return;
+        }
+
+        // Only the completions of a name are a superset of the completions
+        // of a longer name. An empty token only qualifies after a dot, where
+        // all the attributes are listed.
+        bool empty_token = start_offset == cursor_offset;
+        if (!is_identifier(code, start_offset, cursor_offset)
+            || (empty_token && (!lists_all_attributes || start_offset == 0 || code[start_offset - 1] != '.'))
+            || (!empty_token && code[start_offset] == '_'))
+        {
+            return;
+        }
+
+        // The matches that do not extend the token, like the magics
+        // completed from a name, could not be filtered
+        std::string token = code.substr(start_offset, cursor_offset - start_offset);
+        for (const auto& match : reply["matches"])
+        {
+            if (!match.is_string() || !starts_with(match.get_ref<const std::string&>(), token, match_case))
+            {
+                return;
+            }
+        }
+
+        m_code = code;
+        m_cursor_pos = cursor_pos;
+        m_cursor_start = cursor_start;
+        m_cursor_offset = cursor_offset;
+        m_start_offset = start_offset;
+        m_matches = reply["matches"];
+        m_match_case = match_case;
+        m_valid = true;
+    }
+
+    void xcompletion_cache::invalidate()
+    {
+        m_valid = false;
+        m_matches = nl::json();
+    }
+
+    xcompletion_cache& get_completion_cache()
+    {
+        static xcompletion_cache cache;
+        return cache;
+    }
+}
@@ -0,0 +1,83 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_COMPLETION_CACHE_HPP
+#define XPYT_COMPLETION_CACHE_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    // How the completer that filled the cache matches the names with the
+    // token: jedi ignores the case, IPython does not.
+    enum class xcompletion_case
+    {
+        sensitive,
+        insensitive
+    };
+
+    /*********************************
+     * xcompletion_cache declaration *
+     *********************************/
+
+    /**
+     * Matches of the last completion request. When the next request only
+     * adds identifier characters to the completed token, and the user
+     * namespace has not changed in between, its matches are filtered from
+     * the cached ones instead of being computed again. Cursor positions
+     * are in code points, as in the Jupyter protocol. Must be accessed
+     * with the GIL held.
+     *
+     * Completers hide the private names until the token starts with an
+     * underscore, so these tokens always go to the completer.
+     */
+    class xcompletion_cache
+    {
+    public:
+
+        // Fills the reply and returns true on a hit
+        bool get(const std::string& code, int cursor_pos, nl::json& reply) const;
+
+        // Stores the reply of a completion request, which must have
+        // "matches", "cursor_start" and "cursor_end" fields. The cached
+        // matches are filtered with the case rule of the completer. When
+        // lists_all_attributes is false, the completer does not list all
+        // the attributes for an empty token after a dot (IPython omits the
+        // names starting with an underscore), and these are not cached.
+        void put(const std::string& code,
+                 int cursor_pos,
+                 const nl::json& reply,
+                 xcompletion_case match_case,
+                 bool lists_all_attributes = true);
+
+        // Called whenever code may have changed the user namespace
+        void invalidate();
+
+    private:
+
+        std::string m_code;
+        int m_cursor_pos = 0;
+        int m_cursor_start = 0;
+        std::size_t m_cursor_offset = 0;
+        std::size_t m_start_offset = 0;
+        nl::json m_matches;
+        xcompletion_case m_match_case = xcompletion_case::sensitive;
+        bool m_valid = false;
+    };
+
+    xcompletion_cache& get_completion_cache();
+}
+
+#endif
@@ -33,6 +33,8 @@
 #include "xeus-python/xutils.hpp"
 #include "xdebugpy_client.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
+#include "xmetrics.hpp"
 
 namespace nl = nlohmann;
 namespace py = pybind11;
@@ -66,6 +68,7 @@ namespace xpyt
         register_request_handler("attach", std::bind(&debugger::attach_request, this, _1), true);
         register_request_handler("configurationDone", std::bind(&debugger::configuration_done_request, this, _1), true);
         register_request_handler("copyToGlobals", std::bind(&debugger::copy_to_globals_request, this, _1), true);
+        register_request_handler("metrics", std::bind(&debugger::metrics_request, this, _1), false);
     }
 
     debugger::~debugger()
@@ -77,8 +80,8 @@ namespace xpyt
     nl::json debugger::inspect_variables_request(const nl::json& message)
     {
         py::gil_scoped_acquire acquire;
-        py::object pymessage = message;
-        nl::json reply = m_pydebugger.attr("inspect_variables")(pymessage);
+        py::object pymessage = json_to_pyobj(message);
+        nl::json reply = pyobj_to_json(m_pydebugger.attr("inspect_variables")(pymessage));
         return reply;
     }
 
@@ -227,22 +230,40 @@ namespace xpyt
         return forward_message(request);
     }
 
+    // Returns the metrics of the kernel, in the Prometheus text format and
+    // as JSON. It does not need debugpy to be started.
+    nl::json debugger::metrics_request(const nl::json& message)
+    {
+        const xmetrics& metrics = get_metrics();
+        nl::json reply = {
+            {"type", "response"},
+            {"request_seq", message["seq"]},
+            {"success", true},
+            {"command", message["command"]},
+            {"body", {
+                {"prometheus", metrics.to_prometheus()},
+                {"metrics", metrics.to_json()}
+            }}
+        };
+        return reply;
+    }
+
     nl::json debugger::variables_request_impl(const nl::json& message)
     {
         if (base_type::get_stopped_threads().empty())
         {
             py::gil_scoped_acquire acquire;
-            py::object pymessage = message;
-            nl::json reply = m_pydebugger.attr("variables")(pymessage);
+            py::object pymessage = json_to_pyobj(message);
+            nl::json reply = pyobj_to_json(m_pydebugger.attr("variables")(pymessage));
             return reply;
         }
         else
         {
             nl::json rep = base_type::variables_request_impl(message);
             py::gil_scoped_acquire acquire;
-            py::object pymessage = message;
-            py::object pyvariables = rep["body"]["variables"];
-            nl::json reply = m_pydebugger.attr("build_variables_response")(pymessage, pyvariables);
+            py::object pymessage = json_to_pyobj(message);
+            py::object pyvariables = json_to_pyobj(rep["body"]["variables"]);
+            nl::json reply = pyobj_to_json(m_pydebugger.attr("build_variables_response")(pymessage, pyvariables));
             return reply;
         }
     }
@@ -9,8 +9,12 @@
 ****************************************************************************/
 
 #include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
 #include <cmath>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "nlohmann/json.hpp"
@@ -26,7 +30,12 @@
 #include "xeus-python/xutils.hpp"
 
 #include "xdisplay.hpp"
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
+#include "xprofiler.hpp"
+#include "xpublisher.hpp"
+#include "xsvg.hpp"
 
 #ifdef __GNUC__
     #pragma GCC diagnostic push
@@ -45,7 +54,7 @@ namespace xpyt_ipython
 
     void xpublish_display_data(const py::object& data, const py::object& metadata, const py::object& transient, bool update)
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
         // Make sure transient is not None
         py::object transient_ = transient;
@@ -56,11 +65,11 @@ namespace xpyt_ipython
 
         if (update)
         {
-            interp.update_display_data(data, metadata, transient_);
+            publisher.update_display_data(xpyt::pyobj_to_json(data), xpyt::pyobj_to_json(metadata), xpyt::pyobj_to_json(transient_));
         }
         else
         {
-            interp.display_data(data, metadata, transient_);
+            publisher.display_data(xpyt::pyobj_to_json(data), xpyt::pyobj_to_json(metadata), xpyt::pyobj_to_json(transient_));
         }
     }
 
@@ -70,12 +79,12 @@ namespace xpyt_ipython
 
     void xpublish_execution_result(const py::int_& execution_count, const py::object& data, const py::object& metadata)
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
-        nl::json cpp_data = data;
+        nl::json cpp_data = xpyt::pyobj_to_json(data);
         if (cpp_data.size() != 0)
         {
-            interp.publish_execution_result(execution_count, std::move(cpp_data), metadata);
+            publisher.publish_execution_result(execution_count, std::move(cpp_data), xpyt::pyobj_to_json(metadata));
         }
     }
 
@@ -85,9 +94,9 @@ namespace xpyt_ipython
 
     void xclear(bool wait = false)
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
-        interp.clear_output(wait);
+        publisher.clear_output(wait);
     }
 
     /******************
@@ -127,11 +136,11 @@ namespace xpyt_raw
 
     bool safe_exists(const py::object& path)
     {
-        py::module os = py::module::import("os");
+        auto& handles = xpyt::get_handles();
 
         try
         {
-            return xpyt::is_pyobject_true(os.attr("path").attr("exists")(path));
+            return xpyt::is_pyobject_true(handles.os_path().attr(handles.exists)(path));
         }
         catch (py::error_already_set& e)
         {
@@ -149,14 +158,188 @@ namespace xpyt_raw
         return exclude.size() != 0 && std::find(exclude.cbegin(), exclude.cend(), mimetype) != exclude.end();
     }
 
+    bool is_path(const py::object& data)
+    {
+        auto& handles = xpyt::get_handles();
+        const py::module& pathlib = handles.pathlib();
+        return py::isinstance(data, py::make_tuple(pathlib.attr(handles.path), pathlib.attr(handles.pure_path)));
+    }
+
+    /***********************
+     * repr methods lookup *
+     ***********************/
+
+    // Index of the display methods in repr_method_names
+    enum xrepr_method : std::size_t
+    {
+        repr_mimebundle = 0,
+        ipython_display,
+        repr_html,
+        repr_markdown,
+        repr_svg,
+        repr_png,
+        repr_jpeg,
+        repr_latex,
+        repr_json,
+        repr_javascript,
+        repr_pdf,
+        repr_method_count
+    };
+
+    const std::array<const char*, repr_method_count> repr_method_names = {{
+        "_repr_mimebundle_",
+        "_ipython_display_",
+        "_repr_html_",
+        "_repr_markdown_",
+        "_repr_svg_",
+        "_repr_png_",
+        "_repr_jpeg_",
+        "_repr_latex_",
+        "_repr_json_",
+        "_repr_javascript_",
+        "_repr_pdf_"
+    }};
+
+    using xrepr_methods = std::bitset<repr_method_count>;
+
+    struct xrepr_methods_entry
+    {
+        unsigned int m_version_tag;
+        xrepr_methods m_methods;
+    };
+
+    // Types are never dereferenced from the cache: a type deallocated and
+    // another one allocated at the same address has a different version tag.
+    using xrepr_methods_cache = std::unordered_map<PyTypeObject*, xrepr_methods_entry>;
+
+    constexpr std::size_t repr_methods_cache_max_size = 4096;
+
+    xrepr_methods_cache& get_repr_methods_cache()
+    {
+        static xrepr_methods_cache cache;
+        return cache;
+    }
+
+    bool type_dict_contains(PyTypeObject* type, const char* name)
+    {
+#if PY_VERSION_HEX >= 0x030C0000
+        // Static builtin types do not expose their dict in tp_dict
+        py::object dict = py::reinterpret_steal<py::object>(PyType_GetDict(type));
+        return dict && PyDict_GetItemString(dict.ptr(), name) != nullptr;
+#else
+        return type->tp_dict != nullptr && PyDict_GetItemString(type->tp_dict, name) != nullptr;
+#endif
+    }
+
+    // Same lookup in the MRO as the generic attribute lookup of CPython
+    xrepr_methods lookup_type_repr_methods(PyTypeObject* type)
+    {
+        xrepr_methods methods;
+        PyObject* mro = type->tp_mro;
+        if (mro == nullptr)
+        {
+            return methods;
+        }
+
+        for (std::size_t i = 0; i < repr_method_count; ++i)
+        {
+            for (Py_ssize_t j = 0; j < PyTuple_GET_SIZE(mro); ++j)
+            {
+                if (type_dict_contains(reinterpret_cast<PyTypeObject*>(PyTuple_GET_ITEM(mro, j)), repr_method_names[i]))
+                {
+                    methods.set(i);
+                    break;
+                }
+            }
+        }
+        return methods;
+    }
+
+    xrepr_methods lookup_repr_methods(const py::object& obj)
+    {
+        xrepr_methods methods;
+        for (std::size_t i = 0; i < repr_method_count; ++i)
+        {
+            methods.set(i, hasattr(obj, repr_method_names[i]));
+        }
+        return methods;
+    }
+
+    // A type modified while its version tag was being assigned, or with too
+    // many subclasses, keeps a stale tag without the valid flag.
+    bool has_valid_version_tag(PyTypeObject* type)
+    {
+#if PY_VERSION_HEX >= 0x030C0000
+        return PyUnstable_Type_AssignVersionTag(type) != 0;
+#else
+        return PyType_HasFeature(type, Py_TPFLAGS_VALID_VERSION_TAG) && type->tp_version_tag != 0;
+#endif
+    }
+
+    // Returns the display methods available on obj. The lookup in the type
+    // is cached per type and invalidated when the version tag of the type
+    // changes, that is when the type or one of its bases is modified. The
+    // instance dict is still checked for the methods the type does not have.
+    xrepr_methods get_repr_methods(const py::object& obj)
+    {
+        PyTypeObject* type = Py_TYPE(obj.ptr());
+        if (type->tp_getattro != PyObject_GenericGetAttr)
+        {
+            // __getattr__, __getattribute__, modules...
+            return lookup_repr_methods(obj);
+        }
+
+        xrepr_methods methods;
+        auto& cache = get_repr_methods_cache();
+        auto it = cache.find(type);
+        if (has_valid_version_tag(type) && it != cache.end() && it->second.m_version_tag == type->tp_version_tag)
+        {
+            methods = it->second.m_methods;
+        }
+        else
+        {
+            methods = lookup_type_repr_methods(type);
+            // Without a valid version tag, the entry could not be invalidated.
+            // The lookup assigns the tag if the type can have one.
+            if (has_valid_version_tag(type))
+            {
+                if (it == cache.end() && cache.size() >= repr_methods_cache_max_size)
+                {
+                    cache.clear();
+                }
+                cache[type] = { type->tp_version_tag, methods };
+            }
+        }
+
+        if (type->tp_dictoffset != 0 && !methods.all())
+        {
+            py::object dict = py::reinterpret_steal<py::object>(PyObject_GenericGetDict(obj.ptr(), nullptr));
+            if (!dict)
+            {
+                PyErr_Clear();
+            }
+            else if (PyDict_GET_SIZE(dict.ptr()) != 0)
+            {
+                for (std::size_t i = 0; i < repr_method_count; ++i)
+                {
+                    if (!methods.test(i) && PyDict_GetItemString(dict.ptr(), repr_method_names[i]) != nullptr)
+                    {
+                        methods.set(i);
+                    }
+                }
+            }
+        }
+        return methods;
+    }
+
     void compute_repr(
-        const py::object& obj, const std::string& repr_method, const std::string& mimetype,
+        const py::object& obj, const xrepr_methods& methods, xrepr_method repr_method, const std::string& mimetype,
         const std::vector<std::string>& include, const std::vector<std::string>& exclude,
         py::dict& pub_data, py::dict& pub_metadata)
     {
-        if (hasattr(obj, repr_method.c_str()) && should_include(mimetype, include) && !should_exclude(mimetype, exclude))
+        if (methods.test(repr_method) && should_include(mimetype, include) && !should_exclude(mimetype, exclude))
         {
-            const py::object& repr = obj.attr(repr_method.c_str())();
+            const py::object& repr = obj.attr(repr_method_names[repr_method])();
 
             if (!repr.is_none())
             {
@@ -175,31 +358,82 @@ namespace xpyt_raw
         }
     }
 
-    py::tuple mime_bundle_repr(const py::object& obj, const std::vector<std::string>& include = {}, const std::vector<std::string>& exclude = {})
+    /********************************
+     * xfile_stat_scope declaration *
+     ********************************/
+
+    // The representations of a display object read its data several times.
+    // While a scope is alive, the file of a display object is checked with
+    // os.stat on the first access only.
+    class xfile_stat_scope
+    {
+    public:
+
+        xfile_stat_scope();
+        ~xfile_stat_scope();
+
+        xfile_stat_scope(const xfile_stat_scope&) = delete;
+        xfile_stat_scope& operator=(const xfile_stat_scope&) = delete;
+
+        // Identifier of the outermost scope alive, 0 if there is none
+        static std::size_t current();
+
+    private:
+
+        static std::size_t s_depth;
+        static std::size_t s_count;
+    };
+
+    /***********************************
+     * xfile_stat_scope implementation *
+     ***********************************/
+
+    std::size_t xfile_stat_scope::s_depth = 0;
+    std::size_t xfile_stat_scope::s_count = 0;
+
+    xfile_stat_scope::xfile_stat_scope()
+    {
+        if (s_depth++ == 0)
+        {
+            ++s_count;
+        }
+    }
+
+    xfile_stat_scope::~xfile_stat_scope()
+    {
+        --s_depth;
+    }
+
+    std::size_t xfile_stat_scope::current()
+    {
+        return s_depth != 0 ? s_count : 0;
+    }
+
+    py::tuple mime_bundle_repr(const py::object& obj, const xrepr_methods& methods, const std::vector<std::string>& include = {}, const std::vector<std::string>& exclude = {})
     {
-        py::module py_json = py::module::import("json");
-        py::module builtins = py::module::import("builtins");
+        xpyt::xphase_scope phase(xpyt::xcell_phase::format);
+        xfile_stat_scope stat_scope;
         py::dict pub_data;
         py::dict pub_metadata;
 
-        if (hasattr(obj, "_repr_mimebundle_"))
+        if (methods.test(repr_mimebundle))
         {
             pub_data = obj.attr("_repr_mimebundle_")(include, exclude);
         }
         else
         {
-            compute_repr(obj, "_repr_html_", "text/html", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_markdown_", "text/markdown", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_svg_", "image/svg+xml", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_png_", "image/png", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_jpeg_", "image/jpeg", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_latex_", "text/latex", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_json_", "application/json", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_javascript_", "application/javascript", include, exclude, pub_data, pub_metadata);
-            compute_repr(obj, "_repr_pdf_", "application/pdf", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_html, "text/html", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_markdown, "text/markdown", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_svg, "image/svg+xml", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_png, "image/png", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_jpeg, "image/jpeg", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_latex, "text/latex", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_json, "application/json", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_javascript, "application/javascript", include, exclude, pub_data, pub_metadata);
+            compute_repr(obj, methods, repr_pdf, "application/pdf", include, exclude, pub_data, pub_metadata);
         }
 
-        pub_data["text/plain"] = py::str(builtins.attr("repr")(obj));
+        pub_data["text/plain"] = py::repr(obj);
 
         return py::make_tuple(pub_data, pub_metadata);
     }
@@ -243,11 +477,12 @@ namespace xpyt_raw
 
     void xdisplayhook::operator()(const py::object& obj, bool raw = false) const
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
         if (!obj.is_none())
         {
-            if (hasattr(obj, "_ipython_display_"))
+            xrepr_methods methods = get_repr_methods(obj);
+            if (methods.test(ipython_display))
             {
                 obj.attr("_ipython_display_")();
                 return;
@@ -261,12 +496,12 @@ namespace xpyt_raw
             }
             else
             {
-                const py::tuple& repr = mime_bundle_repr(obj);
+                const py::tuple& repr = mime_bundle_repr(obj, methods);
                 pub_data = repr[0];
                 pub_metadata = repr[1];
             }
 
-            interp.publish_execution_result(m_execution_count, pub_data, pub_metadata);
+            publisher.publish_execution_result(m_execution_count, xpyt::pyobj_to_json(pub_data), xpyt::pyobj_to_json(pub_metadata));
         }
     }
 
@@ -283,14 +518,15 @@ namespace xpyt_raw
         bool update,
         bool raw)
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
         for (std::size_t i = 0; i < objs.size(); ++i)
         {
             py::object obj = objs[i];
             if (!obj.is_none())
             {
-                if (hasattr(obj, "_ipython_display_"))
+                xrepr_methods methods = get_repr_methods(obj);
+                if (methods.test(ipython_display))
                 {
                     obj.attr("_ipython_display_")();
                     return;
@@ -304,25 +540,26 @@ namespace xpyt_raw
                 }
                 else
                 {
-                    const py::tuple& repr = mime_bundle_repr(obj, include, exclude);
+                    const py::tuple& repr = mime_bundle_repr(obj, methods, include, exclude);
                     pub_data = repr[0];
                     pub_metadata = repr[1];
                 }
                 pub_metadata.attr("update")(metadata);
 
-                nl::json cpp_transient = transient.is_none() ? nl::json::object() : nl::json(transient);
+                nl::json cpp_transient = transient.is_none() ? nl::json::object() : xpyt::pyobj_to_json(transient);
 
                 if (!display_id.is_none())
                 {
-                    cpp_transient["display_id"] = display_id;
+                    cpp_transient["display_id"] = xpyt::pyobj_to_json(display_id);
                 }
+
                 if (update)
                 {
-                    interp.update_display_data(pub_data, pub_metadata, std::move(cpp_transient));
+                    publisher.update_display_data(xpyt::pyobj_to_json(pub_data), xpyt::pyobj_to_json(pub_metadata), std::move(cpp_transient));
                 }
                 else
                 {
-                    interp.display_data(pub_data, pub_metadata, std::move(cpp_transient));
+                    publisher.display_data(xpyt::pyobj_to_json(pub_data), xpyt::pyobj_to_json(pub_metadata), std::move(cpp_transient));
                 }
             }
         }
@@ -354,9 +591,9 @@ namespace xpyt_raw
 
     void xpublish_display_data(const py::object& data, const py::object& metadata, const py::str& /*source*/, const py::object& transient)
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
-        interp.display_data(data, metadata, transient);
+        publisher.display_data(xpyt::pyobj_to_json(data), xpyt::pyobj_to_json(metadata), xpyt::pyobj_to_json(transient));
     }
 
     void xdisplay_mimetype(const std::string& mimetype, py::args objs, py::kwargs kw)
@@ -432,8 +669,58 @@ namespace xpyt_raw
 
     void xclear(bool wait = false)
     {
-        auto& interp = xeus::get_interpreter();
-        interp.clear_output(wait);
+        auto& publisher = xpyt::get_publisher();
+        publisher.clear_output(wait);
+    }
+
+    // Modification time and size of a file, from its os.stat result
+    py::tuple file_stamp(const py::object& stat)
+    {
+        auto& handles = xpyt::get_handles();
+        return py::make_tuple(stat.attr(handles.st_mtime_ns), stat.attr(handles.st_size));
+    }
+
+    // Returns the first svg element of data (str or bytes) as a str, or None
+    // when the native scanner cannot extract it.
+    py::object extract_svg_element(const py::object& data)
+    {
+        char* buffer = nullptr;
+        Py_ssize_t size = 0;
+        if (PyBytes_Check(data.ptr()))
+        {
+            if (PyBytes_AsStringAndSize(data.ptr(), &buffer, &size) != 0)
+            {
+                throw py::error_already_set();
+            }
+        }
+        else if (PyUnicode_Check(data.ptr()))
+        {
+            buffer = const_cast<char*>(PyUnicode_AsUTF8AndSize(data.ptr(), &size));
+            if (buffer == nullptr)
+            {
+                PyErr_Clear();
+                return py::none();
+            }
+        }
+        else
+        {
+            return py::none();
+        }
+
+        std::size_t begin = 0;
+        std::size_t end = 0;
+        if (!xpyt::find_svg_element(buffer, static_cast<std::size_t>(size), begin, end))
+        {
+            return py::none();
+        }
+
+        PyObject* svg = PyUnicode_DecodeUTF8(buffer + begin, static_cast<Py_ssize_t>(end - begin), nullptr);
+        if (svg == nullptr)
+        {
+            PyErr_Clear();
+            return py::none();
+        }
+        return py::reinterpret_steal<py::object>(svg);
     }
 
     /*******************************
@@ -460,17 +747,32 @@ namespace xpyt_raw
         py::object get_data();
         virtual void set_data(const py::object& data);
 
+        // Setter of the data property, detaches the object from its file
+        void assign_data(const py::object& data);
+
     protected:
 
-        py::object data_and_metadata() const;
+        py::object data_and_metadata();
 
     private:
 
+        void load_file(bool force);
+        py::object read_file() const;
+
         py::object m_data;
         py::object m_url = py::none();
         py::object m_filename = py::none();
         py::object m_metadata = py::none();
-        py::str m_read_flag;
+        bool m_binary;
+
+        // The content of the file is read on first access, and read again
+        // only when the modification time or the size of the file changes.
+        // The file is checked once per stat scope. When the file is removed
+        // or cannot be read anymore, the content last read is kept.
+        bool m_file_backed = false;
+        bool m_file_loaded = false;
+        py::tuple m_file_stamp;
+        std::size_t m_stat_scope = 0;
     };
 
     /**********************************
@@ -478,11 +780,10 @@ namespace xpyt_raw
      **********************************/
 
     xdisplay_object::xdisplay_object(const py::object& data, const py::object& url, const py::object& filename, const py::object& metadata, const std::string& read_flag)
-        : m_data(data), m_url(url), m_filename(filename), m_metadata(metadata), m_read_flag(read_flag)
+        : m_data(data), m_url(url), m_filename(filename), m_metadata(metadata)
+        , m_binary(read_flag.find('b') != std::string::npos)
     {
-        py::module pathlib = py::module::import("pathlib");
-
-        if (py::isinstance(data, py::make_tuple(pathlib.attr("Path"), pathlib.attr("PurePath"))))
+        if (is_path(data))
         {
             m_data = py::str(data);
         }
@@ -503,16 +804,26 @@ namespace xpyt_raw
             }
         }
 
-        reload();
+        if (!m_filename.is_none())
+        {
+            // Raises if the file does not exist, the content is read lazily
+            auto& handles = xpyt::get_handles();
+            handles.os().attr(handles.stat)(m_filename);
+            m_file_backed = true;
+        }
+        else
+        {
+            reload();
+        }
     }
 
     xdisplay_object::~xdisplay_object()
     {
     }
 
-    py::object xdisplay_object::data_and_metadata() const
+    py::object xdisplay_object::data_and_metadata()
     {
-        py::module copy = py::module::import("copy");
+        load_file(false);
 
         if (m_metadata.is_none())
         {
@@ -520,7 +831,8 @@ namespace xpyt_raw
         }
         else
         {
-            return py::make_tuple(m_data, copy.attr("deepcopy")(m_metadata));
+            auto& handles = xpyt::get_handles();
+            return py::make_tuple(m_data, handles.copy().attr(handles.deepcopy)(m_metadata));
         }
     }
 
@@ -536,6 +848,7 @@ namespace xpyt_raw
 
     py::object xdisplay_object::get_data()
     {
+        load_file(false);
         return m_data;
     }
 
@@ -544,24 +857,78 @@ namespace xpyt_raw
         m_data = data;
     }
 
-    void xdisplay_object::reload()
+    void xdisplay_object::assign_data(const py::object& data)
     {
-        py::module builtins = py::module::import("builtins");
+        m_file_backed = false;
+        set_data(data);
+    }
 
-        if (!m_filename.is_none())
+    void xdisplay_object::load_file(bool force)
+    {
+        if (!m_file_backed)
         {
-            py::object fobj;
-            try
+            return;
+        }
+
+        std::size_t scope = xfile_stat_scope::current();
+        if (m_file_loaded && !force && scope != 0 && scope == m_stat_scope)
+        {
+            return;
+        }
+
+        auto& handles = xpyt::get_handles();
+        py::tuple stamp;
+        py::object content;
+        try
+        {
+            stamp = file_stamp(handles.os().attr(handles.stat)(m_filename));
+            m_stat_scope = scope;
+            if (m_file_loaded && !force && stamp.equal(m_file_stamp))
             {
-                fobj = builtins.attr("open")(m_filename, m_read_flag);
-                set_data(fobj.attr("read")());
+                return;
             }
-            catch (py::error_already_set& e)
+            content = read_file();
+        }
+        catch (py::error_already_set& e)
+        {
+            if (force || !m_file_loaded || !e.matches(PyExc_OSError))
             {
-                fobj.attr("close")();
-
-                throw e;
+                throw;
             }
+            m_stat_scope = scope;
+            return;
+        }
+
+        // The virtual set_data of the subclasses parses the content
+        set_data(content);
+        m_file_stamp = stamp;
+        m_file_loaded = true;
+    }
+
+    // Reads the file as IPython does, decoded with the locale encoding and
+    // universal newlines unless it is binary
+    py::object xdisplay_object::read_file() const
+    {
+        auto& handles = xpyt::get_handles();
+        py::object fobj = handles.builtins().attr(handles.open)(m_filename, m_binary ? "rb" : "r");
+        try
+        {
+            py::object content = fobj.attr("read")();
+            fobj.attr("close")();
+            return content;
+        }
+        catch (py::error_already_set&)
+        {
+            fobj.attr("close")();
+            throw;
+        }
+    }
+
+    void xdisplay_object::reload()
+    {
+        if (m_file_backed)
+        {
+            load_file(true);
         }
         else if (!m_url.is_none())
         {
@@ -633,8 +1000,8 @@ namespace xpyt_raw
         xhtml(const py::object& data, const py::object& url, const py::object& filename, const py::object& metadata);
         virtual ~xhtml();
 
-        py::object repr_html() const;
-        py::object html() const;
+        py::object repr_html();
+        py::object html();
 
     };
 
@@ -647,12 +1014,12 @@ namespace xpyt_raw
     {
     }
 
-    py::object xhtml::repr_html() const
+    py::object xhtml::repr_html()
     {
         return data_and_metadata();
     }
 
-    py::object xhtml::html() const
+    py::object xhtml::html()
     {
         return repr_html();
     }
@@ -749,7 +1116,7 @@ namespace xpyt_raw
         xmarkdown(const py::object& data, const py::object& url, const py::object& filename, const py::object& metadata);
         virtual ~xmarkdown();
 
-        py::object repr_markdown() const;
+        py::object repr_markdown();
 
     };
 
@@ -762,7 +1129,7 @@ namespace xpyt_raw
     {
     }
 
-    py::object xmarkdown::repr_markdown() const
+    py::object xmarkdown::repr_markdown()
     {
         return data_and_metadata();
     }
@@ -793,8 +1160,6 @@ namespace xpyt_raw
 
     py::object xmath::repr_latex()
     {
-        py::module copy = py::module::import("copy");
-
         std::ostringstream string_stream;
         string_stream << R"($\displaystyle )" << get_data().attr("strip")("$").cast<std::string>() << "$";
         py::str s = py::str(string_stream.str());
@@ -805,7 +1170,8 @@ namespace xpyt_raw
         }
         else
         {
-            return py::make_tuple(s, copy.attr("deepcopy")(get_metadata()));
+            auto& handles = xpyt::get_handles();
+            return py::make_tuple(s, handles.copy().attr(handles.deepcopy)(get_metadata()));
         }
     }
 
@@ -820,7 +1186,7 @@ namespace xpyt_raw
         xlatex(const py::object& data, const py::object& url, const py::object& filename, const py::object& metadata);
         virtual ~xlatex();
 
-        py::object repr_latex() const;
+        py::object repr_latex();
 
     };
 
@@ -833,7 +1199,7 @@ namespace xpyt_raw
     {
     }
 
-    py::object xlatex::repr_latex() const
+    py::object xlatex::repr_latex()
     {
         return data_and_metadata();
     }
@@ -849,7 +1215,7 @@ namespace xpyt_raw
         xsvg(const py::object& data, const py::object& url, const py::object& filename, const py::object& metadata);
         virtual ~xsvg();
 
-        py::object repr_svg() const;
+        py::object repr_svg();
 
     protected:
 
@@ -874,20 +1240,26 @@ namespace xpyt_raw
             return;
         }
 
-        py::object svg = data;
+        py::object svg = extract_svg_element(data);
 
-        py::module minidom = py::module::import("xml.dom.minidom");
-        py::list found_svg = minidom.attr("parseString")(data).attr("getElementsByTagName")("svg");
-
-        if (py::len(found_svg) != 0)
+        if (svg.is_none())
         {
-            svg = found_svg[0].attr("toxml")();
+            // Documents the scanner does not handle, or invalid ones for
+            // which minidom raises the parsing error
+            svg = data;
+            py::module minidom = py::module::import("xml.dom.minidom");
+            py::list found_svg = minidom.attr("parseString")(data).attr("getElementsByTagName")("svg");
+
+            if (py::len(found_svg) != 0)
+            {
+                svg = found_svg[0].attr("toxml")();
+            }
         }
 
         xdisplay_object::set_data(svg);
     }
 
-    py::object xsvg::repr_svg() const
+    py::object xsvg::repr_svg()
     {
         return data_and_metadata();
     }
@@ -906,7 +1278,7 @@ namespace xpyt_raw
         );
         virtual ~xjson();
 
-        py::object repr_json() const;
+        py::object repr_json();
 
     protected:
 
@@ -935,9 +1307,7 @@ namespace xpyt_raw
 
     void xjson::set_data(const py::object& data)
     {
-        py::module pathlib = py::module::import("pathlib");
-
-        if (py::isinstance(data, py::make_tuple(pathlib.attr("Path"), pathlib.attr("PurePath"))))
+        if (is_path(data))
         {
             xdisplay_object::set_data(py::str(data));
             return;
@@ -945,16 +1315,15 @@ namespace xpyt_raw
 
         if (py::isinstance<py::str>(data))
         {
-            py::module json = py::module::import("json");
-
-            xdisplay_object::set_data(json.attr("loads")(data));
+            auto& handles = xpyt::get_handles();
+            xdisplay_object::set_data(handles.json().attr(handles.loads)(data));
             return;
         }
 
         xdisplay_object::set_data(data);
     }
 
-    py::object xjson::repr_json() const
+    py::object xjson::repr_json()
     {
         return data_and_metadata();
     }
@@ -1009,16 +1378,23 @@ namespace xpyt_raw
      * xprogressbar class *
      **********************/
 
+    /**
+     * Progress bar over an integer range or any iterable. The display is
+     * updated when the width of the text bar changes or when interval has
+     * elapsed since the previous update, and always at the end.
+     */
     class xprogressbar
     {
     public:
 
-        xprogressbar(std::ptrdiff_t total);
+        using clock_type = std::chrono::steady_clock;
+
+        xprogressbar(const py::object& total, double interval);
 
         std::string repr() const;
         std::string repr_html() const;
         const xprogressbar& iter();
-        std::ptrdiff_t next();
+        py::object next();
 
         std::ptrdiff_t get_progress() const;
         void set_progress(std::ptrdiff_t);
@@ -1028,32 +1404,72 @@ namespace xpyt_raw
 
     private:
 
+        std::size_t filled_width() const;
+        void update(bool force);
         void display(bool update) const;
 
         std::ptrdiff_t m_progress = 0;
+        // Negative when the length of the iterable is unknown
         std::ptrdiff_t m_total;
 
         std::size_t m_text_width = 60;
 
+        py::object m_iterable;
+        py::object m_iterator;
+
+        std::chrono::duration<double> m_interval;
+        clock_type::time_point m_last_update;
+        std::size_t m_last_filled = 0;
+
         xeus::xguid m_id;
 
     };
 
-    xprogressbar::xprogressbar(std::ptrdiff_t total)
-        : m_total(total), m_id(xeus::new_xguid())
+    xprogressbar::xprogressbar(const py::object& total, double interval)
+        : m_total(-1), m_interval(interval), m_id(xeus::new_xguid())
     {
+        // Integers of other libraries, like numpy.int64, are totals too
+        if (PyIndex_Check(total.ptr()))
+        {
+            Py_ssize_t value = PyNumber_AsSsize_t(total.ptr(), PyExc_OverflowError);
+            if (value == -1 && PyErr_Occurred())
+            {
+                throw py::error_already_set();
+            }
+            m_total = value;
+        }
+        else
+        {
+            m_iterable = total;
+            Py_ssize_t length = PyObject_Length(total.ptr());
+            if (length < 0)
+            {
+                PyErr_Clear();
+            }
+            else
+            {
+                m_total = length;
+            }
+        }
     }
 
     std::string xprogressbar::repr() const
     {
-        double fraction = double(m_progress) / double(m_total);
-        std::size_t len_filled = floor(fraction * m_text_width);
+        std::size_t len_filled = filled_width();
 
         std::string filled(len_filled, '=');
         std::string rest(m_text_width - len_filled, ' ');
 
         std::ostringstream string_stream;
-        string_stream << "[" << filled << rest << "] " << m_progress << "/" << m_total;
+        string_stream << "[" << filled << rest << "] " << std::max<std::ptrdiff_t>(m_progress, 0) << "/";
+        if (m_total < 0)
+        {
+            string_stream << "?";
+        }
+        else
+        {
+            string_stream << m_total;
+        }
 
         return string_stream.str();
     }
@@ -1061,30 +1477,62 @@ namespace xpyt_raw
     std::string xprogressbar::repr_html() const
     {
         std::ostringstream string_stream;
-        string_stream << "<progress style='width:60ex' max='" << m_total << "' value='" << m_progress << "'></progress>";
+        if (m_total < 0)
+        {
+            // Indeterminate progress element
+            string_stream << "<progress style='width:60ex'></progress> " << std::max<std::ptrdiff_t>(m_progress, 0);
+        }
+        else
+        {
+            string_stream << "<progress style='width:60ex' max='" << m_total << "' value='" << std::max<std::ptrdiff_t>(m_progress, 0) << "'></progress>";
+        }
 
         return string_stream.str();
     }
 
     const xprogressbar& xprogressbar::iter()
     {
+        if (m_iterable)
+        {
+            m_iterator = py::iter(m_iterable);
+        }
+
         display(false);
         m_progress = -1;
+        m_last_filled = filled_width();
+        m_last_update = clock_type::now();
 
         return *this;
     }
 
-    std::ptrdiff_t xprogressbar::next()
+    py::object xprogressbar::next()
     {
-        set_progress(m_progress + 1);
-        if (m_progress < m_total)
+        ++m_progress;
+        if (m_iterator)
         {
-            return m_progress;
+            PyObject* item = PyIter_Next(m_iterator.ptr());
+            if (item != nullptr)
+            {
+                update(false);
+                return py::reinterpret_steal<py::object>(item);
+            }
+            if (PyErr_Occurred())
+            {
+                throw py::error_already_set();
+            }
+            if (m_total < 0)
+            {
+                m_total = m_progress;
+            }
         }
-        else
+        else if (m_progress < m_total)
         {
-            throw py::stop_iteration();
+            update(false);
+            return py::int_(m_progress);
         }
+
+        update(true);
+        throw py::stop_iteration();
     }
 
     std::ptrdiff_t xprogressbar::get_progress() const
@@ -1095,7 +1543,7 @@ namespace xpyt_raw
     void xprogressbar::set_progress(std::ptrdiff_t progress)
     {
         m_progress = progress;
-        display(true);
+        update(m_total >= 0 && m_progress >= m_total);
     }
 
     std::ptrdiff_t xprogressbar::get_total() const
@@ -1106,12 +1554,40 @@ namespace xpyt_raw
     void xprogressbar::set_total(std::ptrdiff_t total)
     {
         m_total = total;
+        update(true);
+    }
+
+    std::size_t xprogressbar::filled_width() const
+    {
+        if (m_total < 0)
+        {
+            return 0;
+        }
+        if (m_total == 0)
+        {
+            return m_text_width;
+        }
+        double fraction = std::min(1.0, std::max(0.0, double(m_progress) / double(m_total)));
+        return static_cast<std::size_t>(std::floor(fraction * m_text_width));
+    }
+
+    void xprogressbar::update(bool force)
+    {
+        auto now = clock_type::now();
+        std::size_t filled = filled_width();
+        if (!force && filled == m_last_filled && now - m_last_update < m_interval)
+        {
+            return;
+        }
+
+        m_last_filled = filled;
+        m_last_update = now;
         display(true);
     }
 
     void xprogressbar::display(bool update) const
     {
-        auto& interp = xeus::get_interpreter();
+        auto& publisher = xpyt::get_publisher();
 
         nl::json cpp_transient;
         cpp_transient["display_id"] = m_id;
@@ -1122,13 +1598,13 @@ namespace xpyt_raw
 
         if (!update)
         {
-            interp.display_data(
+            publisher.display_data(
                 std::move(pub_data), nl::json::object(), std::move(cpp_transient)
             );
         }
         else
         {
-            interp.update_display_data(
+            publisher.update_display_data(
                 std::move(pub_data), nl::json::object(), std::move(cpp_transient)
             );
         }
@@ -1136,12 +1612,12 @@ namespace xpyt_raw
 
     py::object pngxy(const py::object& data)
     {
-        py::module builtins = py::module::import("builtins");
-        py::module struct_module = py::module::import("struct");
+        auto& handles = xpyt::get_handles();
+        const py::module& builtins = handles.builtins();
 
-        std::size_t ihdr = data.attr("index")(builtins.attr("bytes")("IHDR", "UTF8")).cast<std::size_t>();
+        std::size_t ihdr = data.attr("index")(builtins.attr(handles.bytes)("IHDR", "UTF8")).cast<std::size_t>();
 
-        return struct_module.attr("unpack")(">ii", data[builtins.attr("slice")(ihdr + 4, ihdr + 12)]);
+        return handles.struct_module().attr(handles.unpack)(">ii", data[builtins.attr(handles.slice)(ihdr + 4, ihdr + 12)]);
     }
 
     /******************
@@ -1187,7 +1663,7 @@ namespace xpyt_raw
                 py::init<const py::object&, const py::object&, const py::object&, const py::object&>(),
                 py::arg("data") = py::none(), py::arg("url") = py::none(), py::arg("filename") = py::none(), py::arg("metadata") = py::none())
             .def("reload", &xdisplay_object::reload)
-            .def_property("data", &xdisplay_object::get_data, &xdisplay_object::set_data)
+            .def_property("data", &xdisplay_object::get_data, &xdisplay_object::assign_data)
             .def_property("metadata", &xdisplay_object::get_metadata, &xdisplay_object::set_metadata);
 
         py::class_<xtext_display_object, xdisplay_object>(display_module, "TextDisplayObject")
@@ -1248,10 +1724,10 @@ namespace xpyt_raw
             .def("_ipython_display_", &xgeojson::ipython_display);
 
         py::class_<xprogressbar>(display_module, "ProgressBar")
-            .def(py::init<std::ptrdiff_t>(), py::arg("total"))
+            .def(py::init<const py::object&, double>(), py::arg("total"), py::arg("interval") = 0.1)
             .def("__repr__", &xprogressbar::repr)
             .def("_repr_html_", &xprogressbar::repr_html)
-            .def("__iter__", &xprogressbar::iter)
+            .def("__iter__", &xprogressbar::iter, py::return_value_policy::reference_internal)
             .def("__next__", &xprogressbar::next)
             .def_property("progress", &xprogressbar::get_progress, &xprogressbar::set_progress)
             .def_property("total", &xprogressbar::get_total, &xprogressbar::set_total);
@@ -0,0 +1,417 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#if !defined(_WIN32) && !defined(XPYT_EMSCRIPTEN_WASM_BUILD)
+#define XPYT_FD_CAPTURE_SUPPORTED
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "xeus-python/xoptions.hpp"
+
+#include "xfd_capture.hpp"
+#include "xpublisher.hpp"
+#include "xstream.hpp"
+
+namespace xpyt
+{
+    namespace
+    {
+        // Bounds the output kept per file descriptor while it cannot be sent
+        constexpr std::size_t max_buffer_size = std::size_t(1) << 22;
+
+        // Returns the length of the longest prefix of text that does not end
+        // with an incomplete UTF-8 sequence. The remaining bytes are kept
+        // until the rest of the character has been read.
+        std::size_t complete_utf8_size(const std::string& text)
+        {
+            std::size_t size = text.size();
+            std::size_t lookback = size < 3 ? size : 3;
+            for (std::size_t i = 1; i <= lookback; ++i)
+            {
+                unsigned char c = static_cast<unsigned char>(text[size - i]);
+                if ((c & 0xC0) == 0x80)
+                {
+                    // Continuation byte, keep looking for the leading byte
+                    continue;
+                }
+                std::size_t expected = (c & 0xE0) == 0xC0 ? 2
+                                     : (c & 0xF0) == 0xE0 ? 3
+                                     : (c & 0xF8) == 0xF0 ? 4
+                                     : 1;
+                return expected > i ? size - i : size;
+            }
+            return size;
+        }
+    }
+
+    xfd_capture::xfd_capture()
+        : m_fds{{ { 1, -1, -1, "stdout", std::string(), clock_type::time_point(), 0 },
+                  { 2, -1, -1, "stderr", std::string(), clock_type::time_point(), 0 } }}
+        , m_wakeup_fds{{ -1, -1 }}
+        , m_running(false)
+    {
+    }
+
+    xfd_capture::~xfd_capture()
+    {
+        stop();
+    }
+
+#ifdef XPYT_FD_CAPTURE_SUPPORTED
+
+    void xfd_capture::start()
+    {
+        if (m_running.load())
+        {
+            return;
+        }
+
+        if (::pipe(m_wakeup_fds.data()) != 0)
+        {
+            std::clog << "Could not capture the standard file descriptors: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        std::fflush(stdout);
+        std::fflush(stderr);
+        if (!capture(m_fds[0]) || !capture(m_fds[1]))
+        {
+            release(m_fds[0]);
+            release(m_fds[1]);
+            ::close(m_wakeup_fds[0]);
+            ::close(m_wakeup_fds[1]);
+            return;
+        }
+
+        m_running.store(true);
+        m_thread = std::thread(&xfd_capture::run, this);
+    }
+
+    void xfd_capture::stop()
+    {
+        if (!m_running.load())
+        {
+            return;
+        }
+
+        std::fflush(stdout);
+        std::fflush(stderr);
+        m_running.store(false);
+        char wakeup = 0;
+        while (::write(m_wakeup_fds[1], &wakeup, 1) < 0 && errno == EINTR)
+        {
+        }
+        m_thread.join();
+
+        // The descriptors are restored before sending, nothing reads the
+        // pipes anymore
+        output_type output;
+        for (std::size_t i = 0; i < m_fds.size(); ++i)
+        {
+            read_available(m_fds[i]);
+            output[i] = take_output(m_fds[i], true);
+            release(m_fds[i]);
+        }
+        ::close(m_wakeup_fds[0]);
+        ::close(m_wakeup_fds[1]);
+        publish(output);
+    }
+
+    void xfd_capture::flush()
+    {
+        if (!m_running.load())
+        {
+            return;
+        }
+
+        std::fflush(stdout);
+        std::fflush(stderr);
+        output_type output;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::size_t i = 0; i < m_fds.size(); ++i)
+            {
+                read_available(m_fds[i]);
+                output[i] = take_output(m_fds[i], true);
+            }
+        }
+        publish(output);
+    }
+
+    void xfd_capture::write_terminal(const std::string& message)
+    {
+        if (!m_running.load())
+        {
+            std::cout << message;
+            return;
+        }
+
+        const char* data = message.data();
+        std::size_t remaining = message.size();
+        while (remaining != 0)
+        {
+            ssize_t written = ::write(m_fds[0].m_saved_fd, data, remaining);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            data += written;
+            remaining -= static_cast<std::size_t>(written);
+        }
+    }
+
+    bool xfd_capture::capture(xcaptured_fd& captured)
+    {
+        int pipe_fds[2];
+        if (::pipe(pipe_fds) != 0)
+        {
+            std::clog << "Could not capture " << captured.m_name << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        captured.m_saved_fd = ::dup(captured.m_fd);
+        if (captured.m_saved_fd < 0 || ::dup2(pipe_fds[1], captured.m_fd) < 0)
+        {
+            std::clog << "Could not capture " << captured.m_name << ": " << std::strerror(errno) << std::endl;
+            ::close(pipe_fds[0]);
+            ::close(pipe_fds[1]);
+            return false;
+        }
+        ::close(pipe_fds[1]);
+
+        // Child processes inherit the write end only
+        captured.m_read_fd = pipe_fds[0];
+        ::fcntl(captured.m_read_fd, F_SETFL, ::fcntl(captured.m_read_fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(captured.m_read_fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(captured.m_saved_fd, F_SETFD, FD_CLOEXEC);
+        return true;
+    }
+
+    void xfd_capture::release(xcaptured_fd& captured)
+    {
+        if (captured.m_saved_fd >= 0)
+        {
+            ::dup2(captured.m_saved_fd, captured.m_fd);
+            ::close(captured.m_saved_fd);
+            captured.m_saved_fd = -1;
+        }
+        if (captured.m_read_fd >= 0)
+        {
+            ::close(captured.m_read_fd);
+            captured.m_read_fd = -1;
+        }
+    }
+
+    void xfd_capture::read_available(xcaptured_fd& captured)
+    {
+        char chunk[65536];
+        while (true)
+        {
+            ssize_t count = ::read(captured.m_read_fd, chunk, sizeof(chunk));
+            if (count > 0)
+            {
+                if (captured.m_buffer.empty())
+                {
+                    captured.m_buffer_start = clock_type::now();
+                }
+
+                std::size_t size = static_cast<std::size_t>(count);
+                std::size_t room = max_buffer_size - std::min(captured.m_buffer.size(), max_buffer_size);
+                if (captured.m_dropped == 0 && size <= room)
+                {
+                    captured.m_buffer.append(chunk, size);
+                }
+                else
+                {
+                    // The output kept must not end in the middle of a character
+                    std::size_t kept = captured.m_dropped == 0 ? room : 0;
+                    captured.m_buffer.append(chunk, kept);
+                    std::size_t complete = complete_utf8_size(captured.m_buffer);
+                    captured.m_dropped += size - kept + (captured.m_buffer.size() - complete);
+                    captured.m_buffer.resize(complete);
+                }
+            }
+            else if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    void xfd_capture::run()
+    {
+        std::array<pollfd, 3> poll_fds = {{
+            { m_fds[0].m_read_fd, POLLIN, 0 },
+            { m_fds[1].m_read_fd, POLLIN, 0 },
+            { m_wakeup_fds[0], POLLIN, 0 }
+        }};
+
+        while (m_running.load())
+        {
+            // The output that is not due yet is sent by the next periodic
+            // flush of the publisher
+            int res = ::poll(poll_fds.data(), poll_fds.size(), -1);
+            if (res < 0 && errno != EINTR)
+            {
+                break;
+            }
+
+            bool pending = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (xcaptured_fd& captured : m_fds)
+                {
+                    read_available(captured);
+                    pending = pending || !captured.m_buffer.empty();
+                }
+            }
+
+            // The output is sent from the main thread, serialized with the
+            // other messages of the kernel
+            if (pending)
+            {
+                get_publisher().schedule_flush();
+            }
+        }
+    }
+
+    void xfd_capture::flush_due()
+    {
+        if (!m_running.load())
+        {
+            return;
+        }
+
+        output_type output;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::size_t i = 0; i < m_fds.size(); ++i)
+            {
+                output[i] = take_output(m_fds[i], false);
+            }
+        }
+        publish(output);
+    }
+
+#else
+
+    void xfd_capture::start()
+    {
+    }
+
+    void xfd_capture::stop()
+    {
+    }
+
+    void xfd_capture::flush()
+    {
+    }
+
+    void xfd_capture::flush_due()
+    {
+    }
+
+    void xfd_capture::write_terminal(const std::string& message)
+    {
+        std::cout << message;
+    }
+
+    bool xfd_capture::capture(xcaptured_fd&)
+    {
+        return false;
+    }
+
+    void xfd_capture::release(xcaptured_fd&)
+    {
+    }
+
+    void xfd_capture::read_available(xcaptured_fd&)
+    {
+    }
+
+    void xfd_capture::run()
+    {
+    }
+
+#endif
+
+    bool xfd_capture::is_active() const
+    {
+        return m_running.load();
+    }
+
+    std::string xfd_capture::take_output(xcaptured_fd& captured, bool force)
+    {
+        if (captured.m_buffer.empty() && captured.m_dropped == 0)
+        {
+            return std::string();
+        }
+
+        const xstream_options& options = get_stream_options();
+        if (!force && captured.m_dropped == 0 && options.buffer_size != 0 &&
+            captured.m_buffer.size() < options.buffer_size &&
+            clock_type::now() - captured.m_buffer_start < options.flush_interval)
+        {
+            return std::string();
+        }
+
+        std::size_t size = complete_utf8_size(captured.m_buffer);
+        std::string text = captured.m_buffer.substr(0, size);
+        captured.m_buffer.erase(0, size);
+        if (!captured.m_buffer.empty())
+        {
+            captured.m_buffer_start = clock_type::now();
+        }
+
+        if (captured.m_dropped != 0)
+        {
+            // The output dropped follows all the output kept
+            text += "\nOutput dropped: " + std::to_string(captured.m_dropped)
+                  + " bytes written to " + captured.m_name + " could not be sent in time.\n";
+            captured.m_dropped = 0;
+        }
+        return text;
+    }
+
+    void xfd_capture::publish(output_type& output)
+    {
+        for (std::size_t i = 0; i < output.size(); ++i)
+        {
+            if (!output[i].empty())
+            {
+                publish_stream_output(m_fds[i].m_name, std::move(output[i]));
+            }
+        }
+    }
+
+    xfd_capture& get_fd_capture()
+    {
+        static xfd_capture capture;
+        return capture;
+    }
+}
@@ -0,0 +1,106 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_FD_CAPTURE_HPP
+#define XPYT_FD_CAPTURE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace xpyt
+{
+    /**
+     * xfd_capture redirects the file descriptors 1 and 2 to pipes, so that
+     * the output written by native code (C, C++ and Fortran extensions) and
+     * by child processes is sent to the frontend as stream messages.
+     *
+     * A reader thread drains the pipes into buffers, so that the writers
+     * never block, and asks the publisher to send them from the main
+     * thread. The reader never needs the GIL and never sends anything
+     * itself. The output is batched according to the stream options, and
+     * flush() sends what has been written so far; it is called with the
+     * other stream flushes, at the end of the execution of a cell and
+     * before any other output.
+     *
+     * The output is sent after the buffers have been unlocked, so that the
+     * reader keeps draining the pipes if sending writes to them. Each
+     * buffer is bounded: while the output cannot be sent, for instance
+     * when a child process writes while the kernel is idle, the output
+     * past the bound is dropped and replaced by a notice.
+     *
+     * The capture is only available on POSIX platforms, start() does
+     * nothing elsewhere.
+     */
+    class xfd_capture
+    {
+    public:
+
+        xfd_capture();
+        ~xfd_capture();
+
+        xfd_capture(const xfd_capture&) = delete;
+        xfd_capture& operator=(const xfd_capture&) = delete;
+
+        void start();
+        void stop();
+        bool is_active() const;
+
+        void flush();
+
+        // Sends the buffered output that is due according to the stream
+        // options
+        void flush_due();
+
+        // Writes to the original standard output, bypassing the capture
+        void write_terminal(const std::string& message);
+
+    private:
+
+        using clock_type = std::chrono::steady_clock;
+
+        struct xcaptured_fd
+        {
+            int m_fd;
+            int m_saved_fd;
+            int m_read_fd;
+            std::string m_name;
+            std::string m_buffer;
+            clock_type::time_point m_buffer_start;
+            std::size_t m_dropped;
+        };
+
+        using output_type = std::array<std::string, 2>;
+
+        bool capture(xcaptured_fd& captured);
+        void release(xcaptured_fd& captured);
+        void read_available(xcaptured_fd& captured);
+        // Takes the output to send out of the buffer, the mutex must be
+        // held by the caller or the reader thread stopped
+        std::string take_output(xcaptured_fd& captured, bool force);
+        // Must be called without the mutex held
+        void publish(output_type& output);
+        void run();
+
+        std::array<xcaptured_fd, 2> m_fds;
+        std::array<int, 2> m_wakeup_fds;
+        std::atomic<bool> m_running;
+        std::mutex m_mutex;
+        std::thread m_thread;
+    };
+
+    xfd_capture& get_fd_capture();
+}
+
+#endif
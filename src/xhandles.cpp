@@ -0,0 +1,104 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "pybind11/pybind11.h"
+
+#include "xhandles.hpp"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    namespace
+    {
+        py::str interned(const char* name)
+        {
+            PyObject* str = PyUnicode_InternFromString(name);
+            if (str == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            return py::reinterpret_steal<py::str>(str);
+        }
+    }
+
+    /*******************************
+     * xlazy_module implementation *
+     *******************************/
+
+    xlazy_module::xlazy_module(const char* name)
+        : m_name(name)
+    {
+    }
+
+    const py::module& xlazy_module::operator()()
+    {
+        if (!m_module)
+        {
+            m_module = py::module::import(m_name);
+        }
+        return m_module;
+    }
+
+    /***********************************
+     * xhandle_registry implementation *
+     ***********************************/
+
+    xhandle_registry::xhandle_registry()
+        : ast("ast")
+        , builtins("builtins")
+        , copy("copy")
+        , getpass("getpass")
+        , jedi("jedi")
+        , json("json")
+        , keyword("keyword")
+        , os("os")
+        , os_path("os.path")
+        , pathlib("pathlib")
+        , pygments("pygments")
+        , pygments_formatters("pygments.formatters")
+        , pygments_lexers("pygments.lexers")
+        , struct_module("struct")
+        , tokenutil("IPython.utils.tokenutil")
+        , traceback("traceback")
+        , bytes(interned("bytes"))
+        , compile(interned("compile"))
+        , deepcopy(interned("deepcopy"))
+        , exists(interned("exists"))
+        , expr(interned("Expr"))
+        , extract_tb(interned("extract_tb"))
+        , getpass_name(interned("getpass"))
+        , highlight(interned("highlight"))
+        , input(interned("input"))
+        , interactive(interned("Interactive"))
+        , interpreter(interned("Interpreter"))
+        , kwlist(interned("kwlist"))
+        , loads(interned("loads"))
+        , open(interned("open"))
+        , parse(interned("parse"))
+        , path(interned("Path"))
+        , pure_path(interned("PurePath"))
+        , python3_lexer(interned("Python3Lexer"))
+        , slice(interned("slice"))
+        , st_mtime_ns(interned("st_mtime_ns"))
+        , st_size(interned("st_size"))
+        , stat(interned("stat"))
+        , terminal_formatter(interned("TerminalFormatter"))
+        , token_at_cursor(interned("token_at_cursor"))
+        , unpack(interned("unpack"))
+    {
+    }
+
+    xhandle_registry& get_handles()
+    {
+        static xhandle_registry* handles = new xhandle_registry();
+        return *handles;
+    }
+}
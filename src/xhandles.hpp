@@ -0,0 +1,104 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_HANDLES_HPP
+#define XPYT_HANDLES_HPP
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+
+namespace xpyt
+{
+    /**
+     * Python module imported on first access and kept alive afterwards.
+     * Must be accessed with the GIL held.
+     */
+    class xlazy_module
+    {
+    public:
+
+        explicit xlazy_module(const char* name);
+
+        const py::module& operator()();
+
+    private:
+
+        const char* m_name;
+        py::module m_module;
+    };
+
+    /**
+     * Registry of the Python modules and attribute names used on the hot
+     * paths of the kernel (execute, inspect and input requests, displays,
+     * tracebacks, completion index), so that they are not imported and converted to Python
+     * strings on every call.
+     *
+     * The attribute names are interned when the registry is created, the
+     * modules are imported on first use. Must be accessed with the GIL held.
+     */
+    struct xhandle_registry
+    {
+        xhandle_registry();
+
+        xhandle_registry(const xhandle_registry&) = delete;
+        xhandle_registry& operator=(const xhandle_registry&) = delete;
+
+        xlazy_module ast;
+        xlazy_module builtins;
+        xlazy_module copy;
+        xlazy_module getpass;
+        xlazy_module jedi;
+        xlazy_module json;
+        xlazy_module keyword;
+        xlazy_module os;
+        xlazy_module os_path;
+        xlazy_module pathlib;
+        xlazy_module pygments;
+        xlazy_module pygments_formatters;
+        xlazy_module pygments_lexers;
+        xlazy_module struct_module;
+        xlazy_module tokenutil;
+        xlazy_module traceback;
+
+        py::str bytes;
+        py::str compile;
+        py::str deepcopy;
+        py::str exists;
+        py::str expr;
+        py::str extract_tb;
+        py::str getpass_name;
+        py::str highlight;
+        py::str input;
+        py::str interactive;
+        py::str interpreter;
+        py::str kwlist;
+        py::str loads;
+        py::str open;
+        py::str parse;
+        py::str path;
+        py::str pure_path;
+        py::str python3_lexer;
+        py::str slice;
+        py::str st_mtime_ns;
+        py::str st_size;
+        py::str stat;
+        py::str terminal_formatter;
+        py::str token_at_cursor;
+        py::str unpack;
+    };
+
+    // Creates the registry on first call. The registry is never destroyed:
+    // releasing its handles after the finalization of the interpreter is
+    // not allowed.
+    xhandle_registry& get_handles();
+}
+
+#endif
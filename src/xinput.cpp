@@ -17,7 +17,9 @@
 #include "pybind11/functional.h"
 #include "pybind11/pybind11.h"
 
+#include "xhandles.hpp"
 #include "xinput.hpp"
+#include "xpublisher.hpp"
 #include "xeus-python/xutils.hpp"
 
 namespace py = pybind11;
@@ -26,11 +28,13 @@ namespace xpyt
 {
     std::string cpp_input(const std::string& prompt)
     {
+        get_publisher().synchronize();
         return xeus::blocking_input_request(prompt, false);
     }
 
     std::string cpp_getpass(const std::string& prompt)
     {
+        get_publisher().synchronize();
         return xeus::blocking_input_request(prompt, true);
     }
 
@@ -42,26 +46,27 @@ namespace xpyt
     input_redirection::input_redirection(bool allow_stdin)
     {
         // Forward input()
-        py::module builtins = py::module::import("builtins");
-        m_sys_input = builtins.attr("input");
-        builtins.attr("input") = allow_stdin ? py::cpp_function(&cpp_input, py::arg("prompt") = "")
+        auto& handles = get_handles();
+        const py::module& builtins = handles.builtins();
+        m_sys_input = builtins.attr(handles.input);
+        builtins.attr(handles.input) = allow_stdin ? py::cpp_function(&cpp_input, py::arg("prompt") = "")
                                              : py::cpp_function(&notimplemented, py::arg("prompt") = "");
 
         // Forward getpass()
-        py::module getpass = py::module::import("getpass");
-        m_sys_getpass = getpass.attr("getpass");
-        getpass.attr("getpass") = allow_stdin ? py::cpp_function(&cpp_getpass, py::arg("prompt") = "")
+        const py::module& getpass = handles.getpass();
+        m_sys_getpass = getpass.attr(handles.getpass_name);
+        getpass.attr(handles.getpass_name) = allow_stdin ? py::cpp_function(&cpp_getpass, py::arg("prompt") = "")
                                               : py::cpp_function(&notimplemented, py::arg("prompt") = "");
     }
 
     input_redirection::~input_redirection()
     {
+        auto& handles = get_handles();
+
         // Restore input()
-        py::module builtins = py::module::import("builtins");
-        builtins.attr("input") = m_sys_input;
+        handles.builtins().attr(handles.input) = m_sys_input;
 
         // Restore getpass()
-        py::module getpass = py::module::import("getpass");
-        getpass.attr("getpass") = m_sys_getpass;
+        handles.getpass().attr(handles.getpass_name) = m_sys_getpass;
     }
 }
@@ -16,6 +16,7 @@
 
 #include "pybind11/pybind11.h"
 
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
 
 using namespace pybind11::literals;
@@ -24,8 +25,8 @@ namespace xpyt
 {
     py::object static_inspect(const std::string& code)
     {
-        py::module jedi = py::module::import("jedi");
-        return jedi.attr("Interpreter")(code, py::make_tuple(py::globals()));
+        auto& handles = get_handles();
+        return handles.jedi().attr(handles.interpreter)(code, py::make_tuple(py::globals()));
     }
 
     py::object static_inspect(const std::string& code, int cursor_pos)
@@ -8,7 +8,13 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "nlohmann/json.hpp"
@@ -21,12 +27,20 @@
 #include "pybind11/pybind11.h"
 #include "pybind11/eval.h"
 
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
 
 #ifdef WIN32
 #include "Windows.h"
 #endif
 
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace py = pybind11;
 namespace nl = nlohmann;
 
@@ -54,22 +68,81 @@ namespace xpyt
 
     std::string highlight(const std::string& code)
     {
-        py::object py_highlight = py::module::import("pygments").attr("highlight");
-        // py::module::import("pygments").attr("formatters") does NOT work due
-        // to side effects when importing pygments
-        py::object formatter = py::module::import("pygments.formatters").attr("TerminalFormatter");
+        auto& handles = get_handles();
+        py::object py_highlight = handles.pygments().attr(handles.highlight);
+        // Importing pygments and accessing its formatters attribute does NOT
+        // work due to side effects when importing pygments
+        py::object formatter = handles.pygments_formatters().attr(handles.terminal_formatter);
 
-        py::object lexer = py::module::import("pygments.lexers").attr("Python3Lexer");
+        py::object lexer = handles.pygments_lexers().attr(handles.python3_lexer);
 
         return py::str(py_highlight(code, lexer(), formatter()));
     }
 
-    xeus::binary_buffer pybytes_to_cpp_message(py::bytes bytes)
+    std::size_t utf8_offset(const std::string& text, int position)
+    {
+        std::size_t offset = 0;
+        int count = 0;
+        while (count < position && offset < text.size())
+        {
+            ++offset;
+            while (offset < text.size() && (static_cast<unsigned char>(text[offset]) & 0xC0) == 0x80)
+            {
+                ++offset;
+            }
+            ++count;
+        }
+        return count == position ? offset : std::string::npos;
+    }
+
+    bool is_identifier_char(char c)
     {
-        char* buffer;
-        Py_ssize_t length;
-        PyBytes_AsStringAndSize(bytes.ptr(), &buffer, &length);
-        return xeus::binary_buffer(buffer, buffer + static_cast<std::size_t>(length));
+        return static_cast<unsigned char>(c) >= 0x80 || c == '_'
+            || (c >= 'a' && c <= 'z')
+            || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9');
+    }
+
+    xeus::binary_buffer pybuffer_to_cpp_buffer(py::handle buffer)
+    {
+        // Views the memory of the object instead of creating intermediate
+        // bytes, so that it is copied only once into the message.
+        Py_buffer view;
+        if (PyObject_GetBuffer(buffer.ptr(), &view, PyBUF_FULL_RO) != 0)
+        {
+            throw py::error_already_set();
+        }
+
+        xeus::binary_buffer res;
+        int status = 0;
+        {
+            // The exporter cannot release the memory while it is viewed,
+            // other Python threads can run while large buffers are copied.
+            std::unique_ptr<py::gil_scoped_release> release;
+            if (view.len > (1 << 20))
+            {
+                release.reset(new py::gil_scoped_release());
+            }
+
+            if (PyBuffer_IsContiguous(&view, 'C'))
+            {
+                const char* data = static_cast<const char*>(view.buf);
+                res.assign(data, data + view.len);
+            }
+            else
+            {
+                release.reset();
+                res.resize(static_cast<std::size_t>(view.len));
+                status = PyBuffer_ToContiguous(res.data(), &view, view.len, 'C');
+            }
+        }
+        PyBuffer_Release(&view);
+
+        if (status != 0)
+        {
+            throw py::error_already_set();
+        }
+        return res;
     }
 
     py::list cpp_buffers_to_pylist(const xeus::buffer_sequence& buffers)
@@ -77,47 +150,258 @@ namespace xpyt
         py::list bufferlist;
         for (const xeus::binary_buffer& buffer : buffers)
         {
-            bufferlist.attr("append")(
-                py::memoryview(py::bytes(buffer.data(), buffer.size()))
-            );
+            bufferlist.append(py::memoryview(py::bytes(buffer.data(), buffer.size())));
         }
         return bufferlist;
     }
 
-    xeus::buffer_sequence pylist_to_cpp_buffers(const py::object& bufferlist)
+    /*******************
+     * message helpers *
+     *******************/
+
+    // Message is a dict subclass holding the xeus message in its _source
+    // slot. Its sections are converted to Python objects and inserted in the
+    // dict the first time they are looked up; the methods that read or
+    // modify the whole dict convert the remaining ones first.
+
+    namespace
     {
-        xeus::buffer_sequence buffers;
+        const std::array<const char*, 5> message_sections = {{
+            "header", "parent_header", "metadata", "content", "buffers"
+        }};
 
-        // Cannot iterate over NoneType, returning immediately with an empty vector
-        if (bufferlist.is_none())
+        const xeus::xmessage* message_source(py::handle self)
         {
-            return buffers;
+            py::object source = self.attr("_source");
+            if (source.is_none())
+            {
+                return nullptr;
+            }
+            return static_cast<const xeus::xmessage*>(source.cast<py::capsule>());
         }
 
-        for (py::handle buffer : bufferlist)
+        bool is_section(py::handle key)
+        {
+            if (!py::isinstance<py::str>(key))
+            {
+                return false;
+            }
+            std::string name = key.cast<std::string>();
+            return std::find_if(message_sections.cbegin(), message_sections.cend(),
+                                [&name](const char* section) { return name == section; }) != message_sections.cend();
+        }
+
+        py::object convert_section(const xeus::xmessage& msg, const std::string& section)
         {
-            if (py::isinstance<py::memoryview>(buffer))
+            if (section == "header")
             {
-                py::bytes bytes = buffer.attr("tobytes")();
-                buffers.push_back(pybytes_to_cpp_message(bytes));
+                return json_to_pyobj(msg.header());
+            }
+            else if (section == "parent_header")
+            {
+                return json_to_pyobj(msg.parent_header());
+            }
+            else if (section == "metadata")
+            {
+                return json_to_pyobj(msg.metadata());
+            }
+            else if (section == "content")
+            {
+                return json_to_pyobj(msg.content());
             }
             else
             {
-                buffers.push_back(pybytes_to_cpp_message(buffer.cast<py::bytes>()));
+                // xeus hands the message over as const, its buffers cannot
+                // be taken over and are copied.
+                return cpp_buffers_to_pylist(msg.buffers());
             }
         }
-        return buffers;
+
+        // Converts the sections that have not been looked up and releases
+        // the xeus message. The sections keep their order, the keys added
+        // by Python follow them.
+        void materialize_message(py::handle self)
+        {
+            const xeus::xmessage* msg = message_source(self);
+            if (msg == nullptr)
+            {
+                return;
+            }
+
+            py::dict message = py::reinterpret_borrow<py::dict>(self);
+            py::dict items;
+            for (const char* section : message_sections)
+            {
+                py::str key(section);
+                PyObject* value = PyDict_GetItem(message.ptr(), key.ptr());
+                items[key] = value != nullptr ? py::reinterpret_borrow<py::object>(value) : convert_section(*msg, section);
+            }
+            for (auto item : message)
+            {
+                if (!is_section(item.first))
+                {
+                    items[item.first] = item.second;
+                }
+            }
+
+            PyDict_Clear(message.ptr());
+            if (PyDict_Update(message.ptr(), items.ptr()) != 0)
+            {
+                throw py::error_already_set();
+            }
+            self.attr("_source") = py::none();
+        }
+
+        py::object message_missing(py::dict self, py::object key)
+        {
+            const xeus::xmessage* msg = message_source(self);
+            if (msg == nullptr || !is_section(key))
+            {
+                throw py::key_error(static_cast<std::string>(py::repr(key)));
+            }
+            py::object value = convert_section(*msg, key.cast<std::string>());
+            self[key] = value;
+            return value;
+        }
+
+        bool message_contains(py::dict self, py::object key)
+        {
+            int found = PyDict_Contains(self.ptr(), key.ptr());
+            if (found < 0)
+            {
+                throw py::error_already_set();
+            }
+            return found == 1 || (message_source(self) != nullptr && is_section(key));
+        }
+
+        py::object message_get(py::dict self, py::object key, py::object default_value)
+        {
+            return message_contains(self, key) ? py::object(self[key]) : default_value;
+        }
+
+        template <class F, class... Extra>
+        void def_message_method(const py::object& message_type, const char* name, F&& f, const Extra&... extra)
+        {
+            py::cpp_function method(std::forward<F>(f),
+                                    py::name(name),
+                                    py::is_method(message_type),
+                                    py::sibling(py::getattr(message_type, name, py::none())),
+                                    extra...);
+            py::setattr(message_type, name, method);
+        }
+
+        // The dict methods that see the whole message, some of them only
+        // exist in recent versions of Python
+        const std::array<const char*, 19> materializing_methods = {{
+            "__iter__", "__len__", "__repr__", "__eq__", "__ne__", "__reversed__",
+            "__or__", "__ror__", "__ior__", "__delitem__", "keys", "values", "items",
+            "copy", "pop", "popitem", "setdefault", "update", "clear"
+        }};
+    }
+
+    /******************
+     * message module *
+     ******************/
+
+    py::module get_message_module_impl()
+    {
+        py::module message_module = create_module("message");
+
+        // The dict has no __weakref__ slot, so that the only references to
+        // a Message are counted in its ref count.
+        py::object dict_type = py::reinterpret_borrow<py::object>(reinterpret_cast<PyObject*>(&PyDict_Type));
+        py::object type_type = py::reinterpret_borrow<py::object>(reinterpret_cast<PyObject*>(&PyType_Type));
+        py::dict attributes;
+        attributes["__slots__"] = py::make_tuple("_source");
+        attributes["__module__"] = "message";
+        attributes["__doc__"] = "Message received from the frontend, converted lazily.";
+        py::object message_type = type_type("Message", py::make_tuple(dict_type), attributes);
+
+        def_message_method(message_type, "__missing__", &message_missing);
+        def_message_method(message_type, "__contains__", &message_contains);
+        def_message_method(message_type, "get", &message_get, py::arg("key"), py::arg("default") = py::none());
+        def_message_method(message_type, "__reduce_ex__", [](py::dict self, py::object)
+        {
+            // Copies and pickles are plain dicts
+            materialize_message(self);
+            return py::make_tuple(py::reinterpret_borrow<py::object>(reinterpret_cast<PyObject*>(&PyDict_Type)),
+                                  py::make_tuple(py::reinterpret_steal<py::dict>(PyDict_Copy(self.ptr()))));
+        });
+
+        for (const char* name : materializing_methods)
+        {
+            if (!py::hasattr(dict_type, name))
+            {
+                continue;
+            }
+            py::object method = dict_type.attr(name);
+            def_message_method(message_type, name, [method](py::args args, py::kwargs kwargs)
+            {
+                materialize_message(args[0]);
+                return method(*args, **kwargs);
+            });
+        }
+
+        message_module.attr("Message") = message_type;
+        return message_module;
     }
 
-    py::object cppmessage_to_pymessage(const xeus::xmessage& msg)
+    py::module get_message_module()
     {
-        py::dict py_msg;
-        py_msg["header"] = msg.header().get<py::object>();
-        py_msg["parent_header"] = msg.parent_header().get<py::object>();
-        py_msg["metadata"] = msg.metadata().get<py::object>();
-        py_msg["content"] = msg.content().get<py::object>();
-        py_msg["buffers"] = cpp_buffers_to_pylist(msg.buffers());
-        return py_msg;
+        static py::module message_module = get_message_module_impl();
+        return message_module;
+    }
+
+    /***********************************
+     * xpymessage_scope implementation *
+     ***********************************/
+
+    xpymessage_scope::xpymessage_scope(const xeus::xmessage& msg)
+    {
+        m_message = get_message_module().attr("Message")();
+        m_message.attr("_source") = py::capsule(static_cast<const void*>(&msg));
+        // A Message is never empty, the encoders that skip the methods of
+        // empty dicts call items() on it.
+        m_message["header"] = json_to_pyobj(msg.header());
+    }
+
+    xpymessage_scope::~xpymessage_scope()
+    {
+        // Without weak references, Python keeps the message past the callback
+        // exactly when it holds another reference to it.
+        if (m_message.ref_count() > 1)
+        {
+            try
+            {
+                materialize_message(m_message);
+            }
+            catch (std::exception& e)
+            {
+                std::clog << "Error while converting message: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    const py::object& xpymessage_scope::message() const
+    {
+        return m_message;
+    }
+
+    xeus::buffer_sequence pylist_to_cpp_buffers(const py::object& bufferlist)
+    {
+        xeus::buffer_sequence buffers;
+
+        // Cannot iterate over NoneType, returning immediately with an empty vector
+        if (bufferlist.is_none())
+        {
+            return buffers;
+        }
+
+        for (py::handle buffer : bufferlist)
+        {
+            buffers.push_back(pybuffer_to_cpp_buffer(buffer));
+        }
+        return buffers;
     }
 
     std::string get_tmp_prefix()
@@ -136,4 +420,28 @@ namespace xpyt
                                        content,
                                        get_tmp_suffix());
     }
+
+    bool create_private_directory(const std::string& directory)
+    {
+#ifdef _WIN32
+        xeus::create_directory(directory);
+        return true;
+#else
+        std::size_t separator = directory.find_last_of('/');
+        if (separator != std::string::npos && separator != 0)
+        {
+            xeus::create_directory(directory.substr(0, separator));
+        }
+        if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+
+        struct stat info;
+        return lstat(directory.c_str(), &info) == 0
+            && S_ISDIR(info.st_mode)
+            && info.st_uid == getuid()
+            && (info.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+    }
 }
@@ -12,6 +12,8 @@
 #ifndef XPYT_INTERNAL_UTILS_HPP
 #define XPYT_INTERNAL_UTILS_HPP
 
+#include <cstddef>
+#include <string>
 #include <vector>
 
 #include "xeus/xcomm.hpp"
@@ -29,15 +31,51 @@ namespace xpyt
     std::string green_text(const std::string& text);
     std::string blue_text(const std::string& text);
     std::string highlight(const std::string& code);
+
+    // Byte offset of the code point at the given position in UTF-8 text,
+    // or npos if the text is shorter
+    std::size_t utf8_offset(const std::string& text, int position);
+
+    // Non-ASCII bytes are accepted since Python identifiers can contain
+    // any letter
+    bool is_identifier_char(char c);
     
     py::list cpp_buffers_to_pylist(const xeus::buffer_sequence& buffers);
     xeus::buffer_sequence pylist_to_cpp_buffers(const py::object& bufferlist);
 
-    py::object cppmessage_to_pymessage(const xeus::xmessage& msg);
+    /**
+     * Python dict holding a message received from the frontend. The header
+     * is converted when the scope is created, the other sections on first
+     * access. When the scope is destroyed, the sections that have not been
+     * accessed are converted if Python still references the dict, which
+     * then no longer refers to msg. msg is left untouched: its buffers are
+     * copied into bytes objects, exposed as memoryviews.
+     */
+    class xpymessage_scope
+    {
+    public:
+
+        explicit xpymessage_scope(const xeus::xmessage& msg);
+        ~xpymessage_scope();
+
+        xpymessage_scope(const xpymessage_scope&) = delete;
+        xpymessage_scope& operator=(const xpymessage_scope&) = delete;
+
+        const py::object& message() const;
+
+    private:
+
+        py::object m_message;
+    };
 
     std::string get_tmp_prefix();
     std::string get_tmp_suffix();
     std::string get_cell_tmp_file(const std::string& content);
+
+    // Creates the directory with access for the current user only. An
+    // existing directory must belong to the current user, and must not be
+    // writable by others, who could plant files or links in it.
+    bool create_private_directory(const std::string& directory);
 }
 
 #endif
@@ -26,15 +26,25 @@
 
 #include "xeus-python/xinterpreter.hpp"
 #include "xeus-python/xeus_python_config.hpp"
+#include "xeus-python/xoptions.hpp"
 #include "xeus-python/xtraceback.hpp"
 #include "xeus-python/xutils.hpp"
 
 #include "xcomm.hpp"
+#include "xcompletion_cache.hpp"
 #include "xkernel.hpp"
 #include "xdisplay.hpp"
 #include "xinput.hpp"
 #include "xinternal_utils.hpp"
+#include "xhandles.hpp"
+#include "xjson.hpp"
+#include "xfd_capture.hpp"
+#include "xmetrics.hpp"
+#include "xprofiler.hpp"
+#include "xpublisher.hpp"
+#include "xstore.hpp"
 #include "xstream.hpp"
+#include "xsymbol_index.hpp"
 
 namespace py = pybind11;
 namespace nl = nlohmann;
@@ -51,6 +61,9 @@ namespace xpyt
 
     interpreter::~interpreter()
     {
+        get_fd_capture().stop();
+        get_publisher().stop();
+        get_metrics_exporter().stop();
     }
 
     void interpreter::configure_impl()
@@ -62,8 +75,20 @@ namespace xpyt
             m_release_gil = gil_scoped_release_ptr(new py::gil_scoped_release());
         }
 
+        get_publisher().start();
+
+        start_metrics_export();
+
+        if (get_display_options().store_threshold != 0)
+        {
+            register_store_target();
+        }
+
         py::gil_scoped_acquire acquire;
 
+        // Interns the attribute names used on the hot paths
+        get_handles();
+
         py::module sys = py::module::import("sys");
         py::module logging = py::module::import("logging");
 
@@ -109,6 +134,11 @@ namespace xpyt
         {
             redirect_output();
         }
+
+        if (get_completion_options().native_index)
+        {
+            get_symbol_index().update(m_ipython_shell.attr("user_ns"));
+        }
     }
 
     nl::json interpreter::execute_request_impl(int /*execution_count*/,
@@ -118,42 +148,81 @@ namespace xpyt
                                                nl::json user_expressions,
                                                bool allow_stdin)
     {
+        xrequest_metric metric(xrequest_kind::execute, code.size());
         py::gil_scoped_acquire acquire;
         nl::json kernel_res;
 
+        // The cell can change the namespace seen by the completions
+        get_completion_cache().invalidate();
+
+        xcell_profiler& profiler = get_cell_profiler();
+        if (profiler.enabled())
+        {
+            install_profile_hooks();
+            profiler.start_cell();
+        }
+        else
+        {
+            remove_profile_hooks();
+        }
+
         // Reset traceback
         m_ipython_shell.attr("last_error") = py::none();
 
+        reset_output_limits();
+
         // Scope guard performing the temporary monkey patching of input and
         // getpass with a function sending input_request messages.
         auto input_guard = input_redirection(allow_stdin);
 
         py::object ipython_res = m_ipython_shell.attr("run_cell")(code, "store_history"_a=store_history, "silent"_a=silent);
 
-        // Get payload
-        kernel_res["payload"] = m_ipython_shell.attr("payload_manager").attr("read_payload")();
-        m_ipython_shell.attr("payload_manager").attr("clear_payload")();
-
-        if (m_ipython_shell.attr("last_error").is_none())
         {
-            kernel_res["status"] = "ok";
-            kernel_res["user_expressions"] = m_ipython_shell.attr("user_expressions")(user_expressions);
+            xphase_scope phase(xcell_phase::publish);
+
+            // Send the output that is still buffered before the error and the reply
+            report_truncated_output();
+            get_publisher().synchronize();
         }
-        else
+
         {
-            py::list pyerror = m_ipython_shell.attr("last_error");
+            xphase_scope phase(xcell_phase::payload);
 
-            xerror error = extract_error(pyerror);
+            // Get payload
+            kernel_res["payload"] = pyobj_to_json(m_ipython_shell.attr("payload_manager").attr("read_payload")());
+            m_ipython_shell.attr("payload_manager").attr("clear_payload")();
 
-            if (!silent)
+            if (m_ipython_shell.attr("last_error").is_none())
+            {
+                kernel_res["status"] = "ok";
+                kernel_res["user_expressions"] = pyobj_to_json(m_ipython_shell.attr("user_expressions")(json_to_pyobj(user_expressions)));
+            }
+            else
             {
-                publish_execution_error(error.m_ename, error.m_evalue, error.m_traceback);
+                py::list pyerror = m_ipython_shell.attr("last_error");
+
+                xerror error = extract_error(pyerror);
+
+                if (!silent)
+                {
+                    publish_execution_error(error.m_ename, error.m_evalue, error.m_traceback);
+                }
+
+                kernel_res["status"] = "error";
+                kernel_res["ename"] = error.m_ename;
+                kernel_res["evalue"] = error.m_evalue;
+                kernel_res["traceback"] = error.m_traceback;
             }
+        }
 
-            kernel_res["status"] = "error";
-            kernel_res["ename"] = error.m_ename;
-            kernel_res["evalue"] = error.m_evalue;
-            kernel_res["traceback"] = error.m_traceback;
+        if (get_completion_options().native_index)
+        {
+            get_symbol_index().update(m_ipython_shell.attr("user_ns"));
+        }
+
+        if (profiler.is_profiling())
+        {
+            kernel_res["profile"] = profiler.end_cell();
         }
 
         return kernel_res;
@@ -163,9 +232,23 @@ namespace xpyt
         const std::string& code,
         int cursor_pos)
     {
-        py::gil_scoped_acquire acquire;
+        xrequest_metric metric(xrequest_kind::complete, code.size());
         nl::json kernel_res;
 
+        // Answered without the GIL, which can be held by Python threads
+        if (get_completion_options().native_index && get_symbol_index().complete(code, cursor_pos, kernel_res))
+        {
+            return kernel_res;
+        }
+
+        py::gil_scoped_acquire acquire;
+
+        xcompletion_cache& cache = get_completion_cache();
+        if (cache.get(code, cursor_pos, kernel_res))
+        {
+            return kernel_res;
+        }
+
         py::list completion = m_ipython_shell.attr("complete_code")(code, cursor_pos);
 
         kernel_res["matches"] = completion[0];
@@ -174,6 +257,8 @@ namespace xpyt
         kernel_res["metadata"] = nl::json::object();
         kernel_res["status"] = "ok";
 
+        // omit__names hides the private attributes of an empty token
+        cache.put(code, cursor_pos, kernel_res, xcompletion_case::sensitive, false);
         return kernel_res;
     }
 
@@ -181,13 +266,14 @@ namespace xpyt
                                                int cursor_pos,
                                                int detail_level)
     {
+        xrequest_metric metric(xrequest_kind::inspect, code.size());
         py::gil_scoped_acquire acquire;
         nl::json kernel_res;
         nl::json data = nl::json::object();
         bool found = false;
 
-        py::module tokenutil = py::module::import("IPython.utils.tokenutil");
-        py::str name = tokenutil.attr("token_at_cursor")(code, cursor_pos);
+        auto& handles = get_handles();
+        py::str name = handles.tokenutil().attr(handles.token_at_cursor)(code, cursor_pos);
 
         try
         {
@@ -211,6 +297,7 @@ namespace xpyt
 
     nl::json interpreter::is_complete_request_impl(const std::string& code)
     {
+        xrequest_metric metric(xrequest_kind::is_complete, code.size());
         py::gil_scoped_acquire acquire;
         nl::json kernel_res;
 
@@ -233,6 +320,7 @@ namespace xpyt
 
     nl::json interpreter::kernel_info_request_impl()
     {
+        xrequest_metric metric(xrequest_kind::kernel_info, 0);
         nl::json result;
         result["implementation"] = "xeus-python";
         result["implementation_version"] = XPYT_VERSION;
@@ -286,21 +374,27 @@ namespace xpyt
 
     nl::json interpreter::internal_request_impl(const nl::json& content)
     {
-        py::gil_scoped_acquire acquire;
         std::string code = content.value("code", "");
+        xrequest_metric metric(xrequest_kind::internal, code.size());
+        py::gil_scoped_acquire acquire;
         nl::json reply;
 
+        get_completion_cache().invalidate();
+
         // Reset traceback
         m_ipython_shell.attr("last_error") = py::none();
 
         try
         {
             exec(py::str(code));
+            get_publisher().synchronize();
 
             reply["status"] = "ok";
         }
         catch (py::error_already_set& e)
         {
+            get_publisher().synchronize();
+
             // This will grab the latest traceback and set shell.last_error
             m_ipython_shell.attr("showtraceback")();
 
@@ -328,6 +422,159 @@ namespace xpyt
 
         sys.attr("stdout") = stream_module.attr("Stream")("stdout");
         sys.attr("stderr") = stream_module.attr("Stream")("stderr");
+
+        if (get_stream_options().capture_fd)
+        {
+            get_fd_capture().start();
+        }
+    }
+
+    namespace
+    {
+        // Wraps a callable so that its calls are accounted to a phase
+        py::cpp_function profiled(py::object func, xcell_phase phase)
+        {
+            return py::cpp_function([func, phase](py::args args, py::kwargs kwargs) -> py::object
+            {
+                xphase_scope scope(phase);
+                return func(*args, **kwargs);
+            });
+        }
+
+        // Wraps a context manager so that the time spent in its block is
+        // accounted to a phase
+        class xphase_context
+        {
+        public:
+
+            xphase_context(py::object context, xcell_phase phase)
+                : m_context(std::move(context))
+                , m_phase(phase)
+                , m_previous(xcell_phase::execute)
+                , m_active(false)
+            {
+            }
+
+            py::object enter()
+            {
+                py::object res = m_context.attr("__enter__")();
+                m_active = get_cell_profiler().is_profiling();
+                if (m_active)
+                {
+                    m_previous = get_cell_profiler().switch_phase(m_phase);
+                }
+                return res;
+            }
+
+            py::object exit(py::args args)
+            {
+                if (m_active)
+                {
+                    get_cell_profiler().switch_phase(m_previous);
+                    m_active = false;
+                }
+                return m_context.attr("__exit__")(*args);
+            }
+
+        private:
+
+            py::object m_context;
+            xcell_phase m_phase;
+            xcell_phase m_previous;
+            bool m_active;
+        };
+
+        py::module get_profiler_module_impl()
+        {
+            py::module profiler_module = create_module("profiler");
+
+            py::class_<xphase_context>(profiler_module, "PhaseContext")
+                .def("__enter__", &xphase_context::enter)
+                .def("__exit__", &xphase_context::exit);
+
+            return profiler_module;
+        }
+
+        py::module get_profiler_module()
+        {
+            static py::module profiler_module = get_profiler_module_impl();
+            return profiler_module;
+        }
+
+        // Replaces an attribute of an object, and records how to restore it
+        // in hooks
+        void hook_attribute(py::list& hooks, py::object owner, const char* name, py::object hook)
+        {
+            py::object instance_dict = py::getattr(owner, "__dict__", py::none());
+            bool own_attribute = !instance_dict.is_none() && instance_dict.contains(name);
+            py::object original = own_attribute ? py::object(instance_dict[py::str(name)]) : py::none();
+            py::setattr(owner, name, hook);
+            hooks.append(py::make_tuple(owner, name, own_attribute, original));
+        }
+    }
+
+    // The IPython shell runs the whole cell in run_cell. The transformation,
+    // parsing, compilation and formatting steps are measured by wrapping the
+    // methods it calls on itself, its compiler and its display formatter.
+    // The wrappers are instance attributes shadowing the methods, they are
+    // removed when the profile is disabled.
+    void interpreter::install_profile_hooks()
+    {
+        if (m_profile_hooks)
+        {
+            return;
+        }
+        py::list hooks;
+
+        hook_attribute(hooks, m_ipython_shell, "transform_cell",
+                       profiled(m_ipython_shell.attr("transform_cell"), xcell_phase::transform));
+        hook_attribute(hooks, m_ipython_shell, "transform_ast",
+                       profiled(m_ipython_shell.attr("transform_ast"), xcell_phase::transform));
+
+        py::object compiler = m_ipython_shell.attr("compile");
+        hook_attribute(hooks, compiler, "ast_parse",
+                       profiled(compiler.attr("ast_parse"), xcell_phase::compile));
+
+        // The compiler is called directly, which looks __call__ up in its
+        // type. The shell calls it in the block of its extra_flags context
+        // manager only, which is timed instead.
+        get_profiler_module();
+        py::object extra_flags = compiler.attr("extra_flags");
+        hook_attribute(hooks, compiler, "extra_flags", py::cpp_function(
+            [extra_flags](py::args args, py::kwargs kwargs) -> py::object
+            {
+                return py::cast(xphase_context(extra_flags(*args, **kwargs), xcell_phase::compile));
+            }
+        ));
+
+        py::object formatter = m_ipython_shell.attr("display_formatter");
+        hook_attribute(hooks, formatter, "format",
+                       profiled(formatter.attr("format"), xcell_phase::format));
+        m_profile_hooks = std::move(hooks);
+    }
+
+    void interpreter::remove_profile_hooks()
+    {
+        if (!m_profile_hooks)
+        {
+            return;
+        }
+
+        for (py::handle hook : m_profile_hooks)
+        {
+            py::tuple entry = py::reinterpret_borrow<py::tuple>(hook);
+            py::object owner = entry[0];
+            py::str name = entry[1];
+            if (entry[2].cast<bool>())
+            {
+                py::setattr(owner, name, py::object(entry[3]));
+            }
+            else
+            {
+                py::delattr(owner, name);
+            }
+        }
+        m_profile_hooks = py::object();
     }
 
     void interpreter::instanciate_ipython_shell()
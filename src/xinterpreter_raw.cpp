@@ -26,15 +26,25 @@
 
 #include "xeus-python/xinterpreter_raw.hpp"
 #include "xeus-python/xeus_python_config.hpp"
+#include "xeus-python/xoptions.hpp"
 #include "xeus-python/xtraceback.hpp"
 #include "xeus-python/xutils.hpp"
 
+#include "xcode_cache.hpp"
 #include "xcomm.hpp"
+#include "xcompletion_cache.hpp"
 #include "xkernel.hpp"
 #include "xdisplay.hpp"
 #include "xinput.hpp"
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
+#include "xfd_capture.hpp"
+#include "xmetrics.hpp"
+#include "xprofiler.hpp"
+#include "xpublisher.hpp"
+#include "xstore.hpp"
 #include "xstream.hpp"
+#include "xsymbol_index.hpp"
 #include "xinspect.hpp"
 
 namespace py = pybind11;
@@ -55,6 +65,9 @@ namespace xpyt
 
     raw_interpreter::~raw_interpreter()
     {
+        get_fd_capture().stop();
+        get_publisher().stop();
+        get_metrics_exporter().stop();
     }
 
     void raw_interpreter::configure_impl()
@@ -66,8 +79,20 @@ namespace xpyt
             m_release_gil = gil_scoped_release_ptr(new py::gil_scoped_release());
         }
 
+        get_publisher().start();
+
+        start_metrics_export();
+
+        if (get_display_options().store_threshold != 0)
+        {
+            register_store_target();
+        }
+
         py::gil_scoped_acquire acquire;
 
+        // Interns the attribute names used on the hot paths
+        get_handles();
+
         py::module sys = py::module::import("sys");
         py::module jedi = py::module::import("jedi");
         jedi.attr("api").attr("environment").attr("get_default_environment") = py::cpp_function([jedi]() {
@@ -102,6 +127,11 @@ namespace xpyt
         py::globals()["_i"] = "";
         py::globals()["_ii"] = "";
         py::globals()["_iii"] = "";
+
+        if (get_completion_options().native_index)
+        {
+            get_symbol_index().update(py::globals());
+        }
     }
 
     nl::json raw_interpreter::execute_request_impl(
@@ -112,55 +142,51 @@ namespace xpyt
         nl::json /*user_expressions*/,
         bool allow_stdin)
     {
+        xrequest_metric metric(xrequest_kind::execute, code.size());
         py::gil_scoped_acquire acquire;
         nl::json kernel_res;
-        py::str code_copy;
+
+        // The cell can change the namespace seen by the completions
+        get_completion_cache().invalidate();
+
+        xcell_profiler& profiler = get_cell_profiler();
+        if (profiler.enabled())
+        {
+            profiler.start_cell();
+        }
+
         // Scope guard performing the temporary monkey patching of input and
         // getpass with a function sending input_request messages.
         auto input_guard = input_redirection(allow_stdin);
-        code_copy = code;
+        reset_output_limits();
         try
         {
-            // Import modules
-            py::module ast = py::module::import("ast");
-            py::module builtins = py::module::import("builtins");
-
-            // Parse code to AST
-            py::object code_ast = ast.attr("parse")(code_copy, "<string>", "exec");
-            py::list expressions = code_ast.attr("body");
-
             std::string filename = get_cell_tmp_file(code);
             register_filename_mapping(filename, execution_count);
 
-
-            // If the last statement is an expression, we compile it separately
-            // in an interactive mode (This will trigger the display hook)
-            py::object last_stmt = expressions[py::len(expressions) - 1];
-            if (py::isinstance(last_stmt, ast.attr("Expr")))
+            // Re-running a cell does not parse nor compile it again
+            xcompiled_cell cell;
             {
-                code_ast.attr("body").attr("pop")();
-
-                py::list interactive_nodes;
-                interactive_nodes.append(last_stmt);
-
-                py::object interactive_ast = ast.attr("Interactive")(interactive_nodes);
-
-                py::object compiled_code = builtins.attr("compile")(code_ast, filename, "exec");
-
-                py::object compiled_interactive_code = builtins.attr("compile")(interactive_ast, filename, "single");
-
-                if (m_displayhook.ptr() != nullptr)
-                {
-                    m_displayhook.attr("set_execution_count")(execution_count);
-                }
+                xphase_scope phase(xcell_phase::compile);
+                cell = get_code_cache().get(code, filename);
+            }
+            if (!cell.m_last_expression.is_none() && m_displayhook.ptr() != nullptr)
+            {
+                m_displayhook.attr("set_execution_count")(execution_count);
+            }
 
-                exec(compiled_code);
-                exec(compiled_interactive_code);
+            exec(cell.m_body);
+            if (!cell.m_last_expression.is_none())
+            {
+                exec(cell.m_last_expression);
             }
-            else
+
             {
-                py::object compiled_code = builtins.attr("compile")(code_ast, filename, "exec");
-                exec(compiled_code);
+                xphase_scope phase(xcell_phase::publish);
+
+                // Send the output that is still buffered before the reply
+                report_truncated_output();
+                get_publisher().synchronize();
             }
 
             kernel_res["status"] = "ok";
@@ -170,6 +196,13 @@ namespace xpyt
         }
         catch (py::error_already_set& e)
         {
+            {
+                xphase_scope phase(xcell_phase::publish);
+                report_truncated_output();
+                get_publisher().synchronize();
+            }
+
+            xphase_scope phase(xcell_phase::payload);
             xerror error = extract_already_set_error(e);
 
             if (error.m_ename == "SyntaxError")
@@ -196,6 +229,16 @@ namespace xpyt
         py::globals()["_ii"] = py::globals()["_i"];
         py::globals()["_i"] = code;
 
+        if (get_completion_options().native_index)
+        {
+            get_symbol_index().update(py::globals());
+        }
+
+        if (profiler.is_profiling())
+        {
+            kernel_res["profile"] = profiler.end_cell();
+        }
+
         return kernel_res;
     }
 
@@ -203,8 +246,23 @@ namespace xpyt
         const std::string& code,
         int cursor_pos)
     {
-        py::gil_scoped_acquire acquire;
+        xrequest_metric metric(xrequest_kind::complete, code.size());
         nl::json kernel_res;
+
+        // Answered without the GIL, which can be held by Python threads
+        if (get_completion_options().native_index && get_symbol_index().complete(code, cursor_pos, kernel_res))
+        {
+            return kernel_res;
+        }
+
+        py::gil_scoped_acquire acquire;
+
+        xcompletion_cache& cache = get_completion_cache();
+        if (cache.get(code, cursor_pos, kernel_res))
+        {
+            return kernel_res;
+        }
+
         std::vector<std::string> matches;
         int cursor_start = cursor_pos;
 
@@ -224,6 +282,8 @@ namespace xpyt
         kernel_res["matches"] = matches;
         kernel_res["metadata"] = nl::json::object();
         kernel_res["status"] = "ok";
+
+        cache.put(code, cursor_pos, kernel_res, xcompletion_case::insensitive);
         return kernel_res;
     }
 
@@ -231,6 +291,7 @@ namespace xpyt
         int cursor_pos,
         int /*detail_level*/)
     {
+        xrequest_metric metric(xrequest_kind::inspect, code.size());
 
         py::gil_scoped_acquire acquire;
         nl::json kernel_res;
@@ -254,6 +315,7 @@ namespace xpyt
 
     nl::json raw_interpreter::is_complete_request_impl(const std::string&)
     {
+        xrequest_metric metric(xrequest_kind::is_complete, 0);
         nl::json result;
         result["status"] = "complete";
         return result;
@@ -261,6 +323,7 @@ namespace xpyt
 
     nl::json raw_interpreter::kernel_info_request_impl()
     {
+        xrequest_metric metric(xrequest_kind::kernel_info, 0);
         nl::json result;
         result["implementation"] = "xeus-python";
         result["implementation_version"] = XPYT_VERSION;
@@ -322,6 +385,11 @@ namespace xpyt
 
         sys.attr("stdout") = stream_module.attr("Stream")("stdout");
         sys.attr("stderr") = stream_module.attr("Stream")("stderr");
+
+        if (get_stream_options().capture_fd)
+        {
+            get_fd_capture().start();
+        }
     }
 
 }
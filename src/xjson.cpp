@@ -0,0 +1,302 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11_json/pybind11_json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xbase64.hpp"
+#include "xjson.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /*************************
+     * Python object to json *
+     *************************/
+
+    // The containers are walked with the GIL held, but it can be released
+    // during the walk: by bytes_to_json, or by Python code run to convert
+    // the other objects. The items and keys are therefore referenced while
+    // they are converted, so that other threads cannot free them.
+
+    namespace
+    {
+        void to_json(PyObject* obj, nl::json& out);
+
+        void fallback_to_json(PyObject* obj, nl::json& out)
+        {
+            out = pyjson::to_json(py::handle(obj));
+        }
+
+        // The UTF-8 data cached by the str is copied once into a string,
+        // which is then moved into the json value. The keys of the dicts
+        // are moved into the json objects the same way.
+        void str_to_json(PyObject* obj, nl::json& out)
+        {
+            Py_ssize_t size = 0;
+            const char* data = PyUnicode_AsUTF8AndSize(obj, &size);
+            if (data == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            nl::json::string_t value(data, static_cast<std::size_t>(size));
+            out = std::move(value);
+        }
+
+        // Binary data returned by the _repr_*_ methods of images and PDFs,
+        // encoded in base64 like pybind11_json does, without intermediate
+        // Python objects.
+        void bytes_to_json(PyObject* obj, nl::json& out)
+        {
+            char* data = nullptr;
+            Py_ssize_t size = 0;
+            if (PyBytes_AsStringAndSize(obj, &data, &size) != 0)
+            {
+                throw py::error_already_set();
+            }
+
+            nl::json::string_t encoded(base64_encoded_size(static_cast<std::size_t>(size)), '\0');
+            {
+                // bytes are immutable, other Python threads can run while
+                // large images are encoded. The walk holds a reference to
+                // obj and to the containers it is found in, which those
+                // threads could modify.
+                std::unique_ptr<py::gil_scoped_release> release;
+                if (size > (1 << 20))
+                {
+                    release.reset(new py::gil_scoped_release());
+                }
+                base64_encode(data, static_cast<std::size_t>(size), &encoded[0]);
+            }
+            out = std::move(encoded);
+        }
+
+        std::string key_to_string(PyObject* key)
+        {
+            if (PyUnicode_CheckExact(key))
+            {
+                Py_ssize_t size = 0;
+                const char* data = PyUnicode_AsUTF8AndSize(key, &size);
+                if (data == nullptr)
+                {
+                    throw py::error_already_set();
+                }
+                return std::string(data, static_cast<std::size_t>(size));
+            }
+            return py::str(py::handle(key));
+        }
+
+        void dict_to_json(PyObject* obj, nl::json& out)
+        {
+            out = nl::json::object();
+            nl::json::object_t& object = out.get_ref<nl::json::object_t&>();
+            PyObject* key = nullptr;
+            PyObject* value = nullptr;
+            Py_ssize_t pos = 0;
+            while (PyDict_Next(obj, &pos, &key, &value))
+            {
+                py::object key_ref = py::reinterpret_borrow<py::object>(key);
+                py::object value_ref = py::reinterpret_borrow<py::object>(value);
+                to_json(value_ref.ptr(), object[key_to_string(key_ref.ptr())]);
+            }
+        }
+
+        void list_to_json(PyObject* obj, nl::json& out)
+        {
+            Py_ssize_t size = PyList_GET_SIZE(obj);
+            nl::json::array_t array(static_cast<std::size_t>(size));
+            for (Py_ssize_t i = 0; i < size && i < PyList_GET_SIZE(obj); ++i)
+            {
+                py::object item = py::reinterpret_borrow<py::object>(PyList_GET_ITEM(obj, i));
+                to_json(item.ptr(), array[static_cast<std::size_t>(i)]);
+            }
+            out = std::move(array);
+        }
+
+        void tuple_to_json(PyObject* obj, nl::json& out)
+        {
+            Py_ssize_t size = PyTuple_GET_SIZE(obj);
+            nl::json::array_t array(static_cast<std::size_t>(size));
+            for (Py_ssize_t i = 0; i < size; ++i)
+            {
+                py::object item = py::reinterpret_borrow<py::object>(PyTuple_GET_ITEM(obj, i));
+                to_json(item.ptr(), array[static_cast<std::size_t>(i)]);
+            }
+            out = std::move(array);
+        }
+
+        void int_to_json(PyObject* obj, nl::json& out)
+        {
+            int overflow = 0;
+            long long value = PyLong_AsLongLongAndOverflow(obj, &overflow);
+            if (overflow == 0)
+            {
+                if (value == -1 && PyErr_Occurred())
+                {
+                    throw py::error_already_set();
+                }
+                out = static_cast<nl::json::number_integer_t>(value);
+                return;
+            }
+
+            if (overflow > 0)
+            {
+                unsigned long long unsigned_value = PyLong_AsUnsignedLongLong(obj);
+                if (!PyErr_Occurred())
+                {
+                    out = static_cast<nl::json::number_unsigned_t>(unsigned_value);
+                    return;
+                }
+                PyErr_Clear();
+            }
+
+            // Raises the out of range error of pybind11_json
+            fallback_to_json(obj, out);
+        }
+
+        void float_to_json(PyObject* obj, nl::json& out)
+        {
+            out = PyFloat_AS_DOUBLE(obj);
+        }
+
+        void bool_to_json(PyObject* obj, nl::json& out)
+        {
+            out = obj == Py_True;
+        }
+
+        using to_json_function = void (*)(PyObject*, nl::json&);
+
+        struct xto_json_entry
+        {
+            PyTypeObject* p_type;
+            to_json_function p_convert;
+        };
+
+        // Ordered by decreasing frequency in the messages
+        const std::array<xto_json_entry, 8>& to_json_table()
+        {
+            static const std::array<xto_json_entry, 8> table = {{
+                { &PyUnicode_Type, &str_to_json },
+                { &PyDict_Type, &dict_to_json },
+                { &PyList_Type, &list_to_json },
+                { &PyLong_Type, &int_to_json },
+                { &PyFloat_Type, &float_to_json },
+                { &PyBool_Type, &bool_to_json },
+                { &PyTuple_Type, &tuple_to_json },
+                { &PyBytes_Type, &bytes_to_json }
+            }};
+            return table;
+        }
+
+        void to_json(PyObject* obj, nl::json& out)
+        {
+            if (obj == nullptr || obj == Py_None)
+            {
+                out = nullptr;
+                return;
+            }
+
+            PyTypeObject* type = Py_TYPE(obj);
+            for (const xto_json_entry& entry : to_json_table())
+            {
+                if (entry.p_type == type)
+                {
+                    entry.p_convert(obj, out);
+                    return;
+                }
+            }
+            fallback_to_json(obj, out);
+        }
+    }
+
+    nl::json pyobj_to_json(py::handle obj)
+    {
+        nl::json res;
+        to_json(obj.ptr(), res);
+        return res;
+    }
+
+    /*************************
+     * json to Python object *
+     *************************/
+
+    namespace
+    {
+        py::object check_new_reference(PyObject* obj)
+        {
+            if (obj == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            return py::reinterpret_steal<py::object>(obj);
+        }
+
+        py::object string_to_pyobj(const nl::json::string_t& s)
+        {
+            return check_new_reference(PyUnicode_FromStringAndSize(s.data(), static_cast<Py_ssize_t>(s.size())));
+        }
+    }
+
+    py::object json_to_pyobj(const nl::json& j)
+    {
+        switch (j.type())
+        {
+            case nl::json::value_t::null:
+                return py::none();
+            case nl::json::value_t::boolean:
+                return py::bool_(j.get<bool>());
+            case nl::json::value_t::number_integer:
+                return check_new_reference(PyLong_FromLongLong(j.get<nl::json::number_integer_t>()));
+            case nl::json::value_t::number_unsigned:
+                return check_new_reference(PyLong_FromUnsignedLongLong(j.get<nl::json::number_unsigned_t>()));
+            case nl::json::value_t::number_float:
+                return check_new_reference(PyFloat_FromDouble(j.get<nl::json::number_float_t>()));
+            case nl::json::value_t::string:
+                return string_to_pyobj(j.get_ref<const nl::json::string_t&>());
+            case nl::json::value_t::array:
+            {
+                py::object list = check_new_reference(PyList_New(static_cast<Py_ssize_t>(j.size())));
+                Py_ssize_t index = 0;
+                for (const nl::json& item : j)
+                {
+                    PyList_SET_ITEM(list.ptr(), index++, json_to_pyobj(item).release().ptr());
+                }
+                return list;
+            }
+            case nl::json::value_t::object:
+            {
+                py::object dict = check_new_reference(PyDict_New());
+                for (auto it = j.cbegin(); it != j.cend(); ++it)
+                {
+                    py::object key = string_to_pyobj(it.key());
+                    py::object value = json_to_pyobj(it.value());
+                    if (PyDict_SetItem(dict.ptr(), key.ptr(), value.ptr()) != 0)
+                    {
+                        throw py::error_already_set();
+                    }
+                }
+                return dict;
+            }
+            default:
+                return pyjson::from_json(j);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_JSON_HPP
+#define XPYT_JSON_HPP
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * Conversions between nl::json and Python objects for the messages hot
+     * path (display data, comm messages, replies).
+     *
+     * They produce the same results as the pybind11_json conversions, but
+     * dispatch on the exact type of the objects and presize the containers.
+     * Each string is copied once: from the Python object into a string
+     * then moved into the json value, or from the json value into the
+     * Python object. Objects of other types (e.g. subclasses of dict or
+     * tuple) are converted by pybind11_json.
+     */
+    nl::json pyobj_to_json(py::handle obj);
+    py::object json_to_pyobj(const nl::json& j);
+}
+
+#endif
@@ -26,6 +26,8 @@
 
 #include "xkernel.hpp"
 #include "xinternal_utils.hpp"
+#include "xjson.hpp"
+#include "xprofiler.hpp"
 
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -36,6 +38,26 @@ namespace py = pybind11;
 namespace nl = nlohmann;
 using namespace pybind11::literals;
 
+namespace xpyt
+{
+    // Cell profiling properties, shared by the kernel objects of both modes
+
+    bool get_profile_cells(const py::object& /*kernel*/)
+    {
+        return get_cell_profiler().enabled();
+    }
+
+    void set_profile_cells(const py::object& /*kernel*/, bool enabled)
+    {
+        get_cell_profiler().set_enabled(enabled);
+    }
+
+    py::object get_cell_profile(const py::object& /*kernel*/)
+    {
+        return json_to_pyobj(get_cell_profiler().last_profile());
+    }
+}
+
 namespace xpyt_ipython
 {
     /***********************
@@ -57,7 +79,7 @@ namespace xpyt_ipython
 
     py::dict xkernel::get_parent()
     {
-        return py::dict(py::arg("header") = xeus::get_interpreter().parent_header().get<py::object>());
+        return py::dict(py::arg("header") = xpyt::json_to_pyobj(xeus::get_interpreter().parent_header()));
     }
 
     /*****************
@@ -72,7 +94,9 @@ namespace xpyt_ipython
             .def(py::init<>())
             .def("get_parent", &xkernel::get_parent)
             .def_property_readonly("_parent_header", &xkernel::get_parent)
-            .def_readwrite("comm_manager", &xkernel::m_comm_manager);
+            .def_readwrite("comm_manager", &xkernel::m_comm_manager)
+            .def_property("profile_cells", &xpyt::get_profile_cells, &xpyt::set_profile_cells)
+            .def_property_readonly("cell_profile", &xpyt::get_cell_profile);
 
         return kernel_module;
     }
@@ -97,7 +121,7 @@ namespace xpyt_raw
 
         inline py::object parent_header() const
         {
-            return py::dict(py::arg("header") = xeus::get_interpreter().parent_header().get<py::object>());
+            return py::dict(py::arg("header") = xpyt::json_to_pyobj(xeus::get_interpreter().parent_header()));
         }
 
         xpyt::xcomm_manager m_comm_manager;
@@ -184,7 +208,9 @@ namespace xpyt_raw
         py::class_<xmock_kernel>(kernel_module, "MockKernel", py::dynamic_attr())
             .def(py::init<>())
             .def_property_readonly("_parent_header", &xmock_kernel::parent_header)
-            .def_readwrite("comm_manager", &xmock_kernel::m_comm_manager);
+            .def_readwrite("comm_manager", &xmock_kernel::m_comm_manager)
+            .def_property("profile_cells", &xpyt::get_profile_cells, &xpyt::set_profile_cells)
+            .def_property_readonly("cell_profile", &xpyt::get_cell_profile);
 
         py::class_<xmock_ipython>(kernel_module, "MockIPython")
             .def(py::init<>())
@@ -0,0 +1,341 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xsystem.hpp"
+
+#include "xeus-python/xoptions.hpp"
+
+#include "xmetrics.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        const char* request_kind_names[request_kind_count] = {
+            "execute",
+            "complete",
+            "inspect",
+            "is_complete",
+            "kernel_info",
+            "internal",
+            "comm_open",
+            "comm_msg",
+            "comm_close"
+        };
+
+        const char* publication_kind_names[publication_kind_count] = {
+            "stream",
+            "display_data",
+            "update_display_data",
+            "execute_result",
+            "clear_output"
+        };
+
+        constexpr double nanoseconds_per_second = 1e9;
+    }
+
+    /*****************************
+     * xhistogram implementation *
+     *****************************/
+
+    constexpr std::size_t xhistogram::bucket_count;
+
+    const std::array<double, xhistogram::bucket_count - 1>& xhistogram::bounds()
+    {
+        static const std::array<double, bucket_count - 1> res = {
+            0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+            0.25, 0.5, 1., 2.5, 5., 10., 60.
+        };
+        return res;
+    }
+
+    xhistogram::xhistogram()
+        : m_sum(0)
+    {
+        for (auto& count : m_counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void xhistogram::record(duration_type duration)
+    {
+        double seconds = static_cast<double>(duration.count()) / nanoseconds_per_second;
+        const auto& upper_bounds = bounds();
+        std::size_t bucket = 0;
+        while (bucket < upper_bounds.size() && seconds > upper_bounds[bucket])
+        {
+            ++bucket;
+        }
+
+        m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(static_cast<std::uint64_t>(duration.count()), std::memory_order_relaxed);
+    }
+
+    std::array<std::uint64_t, xhistogram::bucket_count> xhistogram::counts() const
+    {
+        std::array<std::uint64_t, bucket_count> res;
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            res[i] = m_counts[i].load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    double xhistogram::sum() const
+    {
+        return static_cast<double>(m_sum.load(std::memory_order_relaxed)) / nanoseconds_per_second;
+    }
+
+    /***************************
+     * xmetrics implementation *
+     ***************************/
+
+    void xmetrics::record_request(xrequest_kind kind, std::size_t bytes, xhistogram::duration_type duration)
+    {
+        xrequest_metrics& metrics = m_requests[static_cast<std::size_t>(kind)];
+        metrics.m_count.fetch_add(1, std::memory_order_relaxed);
+        metrics.m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        metrics.m_latency.record(duration);
+    }
+
+    void xmetrics::record_publication(xpublication_kind kind, std::size_t bytes)
+    {
+        xpublication_metrics& metrics = m_publications[static_cast<std::size_t>(kind)];
+        metrics.m_count.fetch_add(1, std::memory_order_relaxed);
+        metrics.m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // The counters are read one by one: a snapshot taken while requests
+    // are recorded can be off by the requests in flight.
+    std::string xmetrics::to_prometheus() const
+    {
+        std::ostringstream out;
+        out.precision(12);
+
+        out << "# HELP xeus_python_requests_total Number of requests handled by the kernel.\n"
+            << "# TYPE xeus_python_requests_total counter\n";
+        for (std::size_t i = 0; i < request_kind_count; ++i)
+        {
+            out << "xeus_python_requests_total{request=\"" << request_kind_names[i] << "\"} "
+                << m_requests[i].m_count.load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP xeus_python_request_bytes_total Size of the code and binary buffers of the requests.\n"
+            << "# TYPE xeus_python_request_bytes_total counter\n";
+        for (std::size_t i = 0; i < request_kind_count; ++i)
+        {
+            out << "xeus_python_request_bytes_total{request=\"" << request_kind_names[i] << "\"} "
+                << m_requests[i].m_bytes.load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP xeus_python_request_duration_seconds Time spent handling the requests.\n"
+            << "# TYPE xeus_python_request_duration_seconds histogram\n";
+        const auto& bounds = xhistogram::bounds();
+        for (std::size_t i = 0; i < request_kind_count; ++i)
+        {
+            const xhistogram& latency = m_requests[i].m_latency;
+            auto counts = latency.counts();
+            std::uint64_t cumulated = 0;
+            for (std::size_t j = 0; j < xhistogram::bucket_count; ++j)
+            {
+                cumulated += counts[j];
+                out << "xeus_python_request_duration_seconds_bucket{request=\"" << request_kind_names[i] << "\",le=\"";
+                if (j < bounds.size())
+                {
+                    out << bounds[j];
+                }
+                else
+                {
+                    out << "+Inf";
+                }
+                out << "\"} " << cumulated << "\n";
+            }
+            out << "xeus_python_request_duration_seconds_sum{request=\"" << request_kind_names[i] << "\"} "
+                << latency.sum() << "\n";
+            out << "xeus_python_request_duration_seconds_count{request=\"" << request_kind_names[i] << "\"} "
+                << cumulated << "\n";
+        }
+
+        out << "# HELP xeus_python_publications_total Number of messages published on iopub.\n"
+            << "# TYPE xeus_python_publications_total counter\n";
+        for (std::size_t i = 0; i < publication_kind_count; ++i)
+        {
+            out << "xeus_python_publications_total{type=\"" << publication_kind_names[i] << "\"} "
+                << m_publications[i].m_count.load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP xeus_python_publication_bytes_total Size of the text of the messages published on iopub.\n"
+            << "# TYPE xeus_python_publication_bytes_total counter\n";
+        for (std::size_t i = 0; i < publication_kind_count; ++i)
+        {
+            out << "xeus_python_publication_bytes_total{type=\"" << publication_kind_names[i] << "\"} "
+                << m_publications[i].m_bytes.load(std::memory_order_relaxed) << "\n";
+        }
+
+        return out.str();
+    }
+
+    nl::json xmetrics::to_json() const
+    {
+        nl::json requests = nl::json::object();
+        for (std::size_t i = 0; i < request_kind_count; ++i)
+        {
+            const xrequest_metrics& metrics = m_requests[i];
+            requests[request_kind_names[i]] = {
+                { "count", metrics.m_count.load(std::memory_order_relaxed) },
+                { "bytes", metrics.m_bytes.load(std::memory_order_relaxed) },
+                { "latency", {
+                    { "buckets", metrics.m_latency.counts() },
+                    { "sum", metrics.m_latency.sum() }
+                } }
+            };
+        }
+
+        nl::json publications = nl::json::object();
+        for (std::size_t i = 0; i < publication_kind_count; ++i)
+        {
+            publications[publication_kind_names[i]] = {
+                { "count", m_publications[i].m_count.load(std::memory_order_relaxed) },
+                { "bytes", m_publications[i].m_bytes.load(std::memory_order_relaxed) }
+            };
+        }
+
+        return {
+            { "requests", std::move(requests) },
+            { "publications", std::move(publications) },
+            { "latency_bounds", xhistogram::bounds() }
+        };
+    }
+
+    xmetrics& get_metrics()
+    {
+        static xmetrics metrics;
+        return metrics;
+    }
+
+    /**********************************
+     * xrequest_metric implementation *
+     **********************************/
+
+    xrequest_metric::xrequest_metric(xrequest_kind kind, std::size_t bytes)
+        : m_kind(kind)
+        , m_bytes(bytes)
+        , m_start(clock_type::now())
+    {
+    }
+
+    xrequest_metric::~xrequest_metric()
+    {
+        auto duration = std::chrono::duration_cast<xhistogram::duration_type>(clock_type::now() - m_start);
+        get_metrics().record_request(m_kind, m_bytes, duration);
+    }
+
+    /************************************
+     * xmetrics_exporter implementation *
+     ************************************/
+
+    xmetrics_exporter::~xmetrics_exporter()
+    {
+        stop();
+    }
+
+    void xmetrics_exporter::start(const std::string& path, std::chrono::milliseconds interval)
+    {
+#ifndef XPYT_EMSCRIPTEN_WASM_BUILD
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+        {
+            m_path = path;
+            // A null interval would make the thread spin
+            m_interval = std::max(interval, min_metrics_export_interval);
+            m_running = true;
+            m_thread = std::thread(&xmetrics_exporter::run, this);
+        }
+#endif
+    }
+
+    void xmetrics_exporter::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running)
+            {
+                return;
+            }
+            m_running = false;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+        write();
+    }
+
+    bool xmetrics_exporter::write() const
+    {
+        std::string temp_path = m_path + "." + std::to_string(xeus::get_current_pid()) + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::trunc);
+            file << get_metrics().to_prometheus();
+            file.close();
+            if (!file)
+            {
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+        return std::rename(temp_path.c_str(), m_path.c_str()) == 0;
+    }
+
+    void xmetrics_exporter::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running)
+        {
+            if (m_cv.wait_for(lock, m_interval, [this]() { return !m_running; }))
+            {
+                break;
+            }
+            lock.unlock();
+            write();
+            lock.lock();
+        }
+    }
+
+    xmetrics_exporter& get_metrics_exporter()
+    {
+        static xmetrics_exporter exporter;
+        return exporter;
+    }
+
+    void start_metrics_export()
+    {
+        const xmetrics_options& options = get_metrics_options();
+        if (!options.file.empty())
+        {
+            get_metrics_exporter().start(options.file, options.export_interval);
+        }
+    }
+}
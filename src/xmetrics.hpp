@@ -0,0 +1,196 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_METRICS_HPP
+#define XPYT_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    // Requests handled by the kernel, including the comm messages
+    enum class xrequest_kind
+    {
+        execute,
+        complete,
+        inspect,
+        is_complete,
+        kernel_info,
+        internal,
+        comm_open,
+        comm_msg,
+        comm_close
+    };
+
+    constexpr std::size_t request_kind_count = 9;
+
+    // Messages sent on the iopub channel by the publisher
+    enum class xpublication_kind
+    {
+        stream,
+        display_data,
+        update_display_data,
+        execute_result,
+        clear_output
+    };
+
+    constexpr std::size_t publication_kind_count = 5;
+
+    /**************************
+     * xhistogram declaration *
+     **************************/
+
+    /**
+     * Histogram of durations with fixed buckets. Updates are lock-free and
+     * can be made from any thread.
+     */
+    class xhistogram
+    {
+    public:
+
+        using duration_type = std::chrono::nanoseconds;
+
+        static constexpr std::size_t bucket_count = 16;
+
+        // Upper bounds of the buckets in seconds, the last bucket being
+        // unbounded
+        static const std::array<double, bucket_count - 1>& bounds();
+
+        xhistogram();
+
+        void record(duration_type duration);
+
+        // Number of durations in each bucket, not cumulated
+        std::array<std::uint64_t, bucket_count> counts() const;
+        double sum() const;
+
+    private:
+
+        std::array<std::atomic<std::uint64_t>, bucket_count> m_counts;
+        std::atomic<std::uint64_t> m_sum;
+    };
+
+    /************************
+     * xmetrics declaration *
+     ************************/
+
+    /**
+     * Counters and latency histograms of the requests handled by the
+     * kernel and of the messages it publishes. The memory is allocated
+     * once, and updates are lock-free.
+     */
+    class xmetrics
+    {
+    public:
+
+        void record_request(xrequest_kind kind, std::size_t bytes, xhistogram::duration_type duration);
+        void record_publication(xpublication_kind kind, std::size_t bytes);
+
+        // Prometheus text exposition format
+        std::string to_prometheus() const;
+        nl::json to_json() const;
+
+    private:
+
+        struct xrequest_metrics
+        {
+            std::atomic<std::uint64_t> m_count{0};
+            std::atomic<std::uint64_t> m_bytes{0};
+            xhistogram m_latency;
+        };
+
+        struct xpublication_metrics
+        {
+            std::atomic<std::uint64_t> m_count{0};
+            std::atomic<std::uint64_t> m_bytes{0};
+        };
+
+        std::array<xrequest_metrics, request_kind_count> m_requests;
+        std::array<xpublication_metrics, publication_kind_count> m_publications;
+    };
+
+    xmetrics& get_metrics();
+
+    /*******************************
+     * xrequest_metric declaration *
+     *******************************/
+
+    // Records a request when it goes out of scope
+    class xrequest_metric
+    {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        xrequest_metric(xrequest_kind kind, std::size_t bytes);
+        ~xrequest_metric();
+
+        xrequest_metric(const xrequest_metric&) = delete;
+        xrequest_metric& operator=(const xrequest_metric&) = delete;
+
+    private:
+
+        xrequest_kind m_kind;
+        std::size_t m_bytes;
+        clock_type::time_point m_start;
+    };
+
+    /*********************************
+     * xmetrics_exporter declaration *
+     *********************************/
+
+    /**
+     * Writes the metrics to a file in the Prometheus text format at a
+     * regular interval, from a dedicated thread. The file is replaced
+     * atomically, and written a last time when the exporter stops.
+     */
+    class xmetrics_exporter
+    {
+    public:
+
+        ~xmetrics_exporter();
+
+        void start(const std::string& path, std::chrono::milliseconds interval);
+        void stop();
+
+        // Returns false if the file could not be written
+        bool write() const;
+
+    private:
+
+        void run();
+
+        std::string m_path;
+        std::chrono::milliseconds m_interval;
+        bool m_running = false;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::thread m_thread;
+    };
+
+    xmetrics_exporter& get_metrics_exporter();
+
+    // Starts the exporter when a metrics file is set in the options
+    void start_metrics_export();
+}
+
+#endif
@@ -0,0 +1,147 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "xeus-python/xoptions.hpp"
+#include "xeus-python/xutils.hpp"
+
+namespace xpyt
+{
+    xstream_options& get_stream_options()
+    {
+        static xstream_options options;
+        return options;
+    }
+
+    xdisplay_options& get_display_options()
+    {
+        static xdisplay_options options;
+        return options;
+    }
+
+    xcomm_options& get_comm_options()
+    {
+        static xcomm_options options;
+        return options;
+    }
+
+    xexecution_options& get_execution_options()
+    {
+        static xexecution_options options;
+        return options;
+    }
+
+    xmetrics_options& get_metrics_options()
+    {
+        static xmetrics_options options;
+        return options;
+    }
+
+    xcompletion_options& get_completion_options()
+    {
+        static xcompletion_options options;
+        return options;
+    }
+
+    namespace
+    {
+        // Parses an integer between min_value and max_value
+        unsigned long long parse_unsigned(const std::string& name,
+                                          const std::string& value,
+                                          unsigned long long min_value,
+                                          unsigned long long max_value)
+        {
+            // std::stoull accepts leading spaces and signs, "-1" wrapping
+            // around to the largest value
+            bool valid = !value.empty() && value[0] >= '0' && value[0] <= '9';
+            std::size_t pos = 0;
+            unsigned long long res = 0;
+            if (valid)
+            {
+                try
+                {
+                    res = std::stoull(value, &pos);
+                }
+                catch (const std::logic_error&)
+                {
+                    valid = false;
+                }
+            }
+
+            if (!valid || pos != value.size() || res < min_value || res > max_value)
+            {
+                throw std::invalid_argument("invalid value '" + value + "' for option " + name
+                                            + ": expected an integer between " + std::to_string(min_value)
+                                            + " and " + std::to_string(max_value));
+            }
+            return res;
+        }
+
+        void extract_size(const std::string& name, int argc, char* argv[], std::size_t& option)
+        {
+            std::string value = extract_parameter(name, argc, argv);
+            if (!value.empty())
+            {
+                option = static_cast<std::size_t>(
+                    parse_unsigned(name, value, 0, std::numeric_limits<std::size_t>::max())
+                );
+            }
+        }
+
+        void extract_interval(const std::string& name, int argc, char* argv[], std::chrono::milliseconds& option,
+                              std::chrono::milliseconds min_value = std::chrono::milliseconds(0))
+        {
+            std::string value = extract_parameter(name, argc, argv);
+            if (!value.empty())
+            {
+                auto max_value = static_cast<unsigned long long>(std::chrono::milliseconds::max().count());
+                option = std::chrono::milliseconds(
+                    static_cast<std::chrono::milliseconds::rep>(
+                        parse_unsigned(name, value, static_cast<unsigned long long>(min_value.count()), max_value)
+                    )
+                );
+            }
+        }
+    }
+
+    void extract_kernel_options(int argc, char* argv[])
+    {
+        xstream_options& stream_options = get_stream_options();
+        extract_size("--stream-buffer-size", argc, argv, stream_options.buffer_size);
+        extract_interval("--stream-flush-interval", argc, argv, stream_options.flush_interval);
+        extract_size("--stream-max-cell-bytes", argc, argv, stream_options.max_cell_bytes);
+        extract_size("--stream-max-cell-messages", argc, argv, stream_options.max_cell_messages);
+        stream_options.compact_output = !extract_option("--no-stream-compaction", "--no-stream-compaction", argc, argv);
+        stream_options.capture_fd = extract_option("--capture-fd", "--capture-fd", argc, argv);
+
+        xdisplay_options& display_options = get_display_options();
+        display_options.deduplicate_updates = !extract_option("--no-display-deduplication", "--no-display-deduplication", argc, argv);
+        extract_interval("--display-update-interval", argc, argv, display_options.update_interval);
+        extract_size("--display-store-threshold", argc, argv, display_options.store_threshold);
+        display_options.store_directory = extract_parameter("--display-store-dir", argc, argv);
+
+        xcomm_options& comm_options = get_comm_options();
+        comm_options.coalesce_updates = extract_option("--coalesce-comm-updates", "--coalesce-comm-updates", argc, argv);
+        extract_interval("--comm-coalesce-interval", argc, argv, comm_options.coalesce_interval);
+
+        get_execution_options().profile_cells = extract_option("--profile-cells", "--profile-cells", argc, argv);
+
+        xmetrics_options& metrics_options = get_metrics_options();
+        metrics_options.file = extract_parameter("--metrics-file", argc, argv);
+        extract_interval("--metrics-interval", argc, argv, metrics_options.export_interval, min_metrics_export_interval);
+
+        get_completion_options().native_index = extract_option("--completion-index", "--completion-index", argc, argv);
+    }
+}
@@ -0,0 +1,137 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus-python/xoptions.hpp"
+
+#include "xprofiler.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        const char* cell_phase_names[cell_phase_count] = {
+            "transform",
+            "compile",
+            "execute",
+            "format",
+            "publish",
+            "payload"
+        };
+
+        double to_seconds(xcell_profiler::clock_type::duration duration)
+        {
+            return std::chrono::duration<double>(duration).count();
+        }
+    }
+
+    /*********************************
+     * xcell_profiler implementation *
+     *********************************/
+
+    xcell_profiler::xcell_profiler()
+        : m_enabled(get_execution_options().profile_cells)
+        , m_running(false)
+        , m_phase(xcell_phase::execute)
+        , m_last_profile(nl::json::object())
+    {
+    }
+
+    bool xcell_profiler::enabled() const
+    {
+        return m_enabled;
+    }
+
+    void xcell_profiler::set_enabled(bool enabled)
+    {
+        m_enabled = enabled;
+    }
+
+    void xcell_profiler::start_cell()
+    {
+        m_durations.fill(clock_type::duration::zero());
+        m_phase = xcell_phase::execute;
+        m_cell_start = clock_type::now();
+        m_phase_start = m_cell_start;
+        m_thread = std::this_thread::get_id();
+        m_running.store(true);
+    }
+
+    nl::json xcell_profiler::end_cell()
+    {
+        switch_phase(xcell_phase::execute);
+        m_running.store(false);
+
+        nl::json profile = nl::json::object();
+        for (std::size_t i = 0; i < cell_phase_count; ++i)
+        {
+            profile[cell_phase_names[i]] = to_seconds(m_durations[i]);
+        }
+        profile["total"] = to_seconds(m_phase_start - m_cell_start);
+        m_last_profile = profile;
+        return profile;
+    }
+
+    bool xcell_profiler::is_profiling() const
+    {
+        return m_running.load() && m_thread == std::this_thread::get_id();
+    }
+
+    const nl::json& xcell_profiler::last_profile() const
+    {
+        return m_last_profile;
+    }
+
+    xcell_phase xcell_profiler::switch_phase(xcell_phase phase)
+    {
+        auto now = clock_type::now();
+        m_durations[static_cast<std::size_t>(m_phase)] += now - m_phase_start;
+        m_phase_start = now;
+
+        xcell_phase previous = m_phase;
+        m_phase = phase;
+        return previous;
+    }
+
+    xcell_profiler& get_cell_profiler()
+    {
+        static xcell_profiler profiler;
+        return profiler;
+    }
+
+    /*******************************
+     * xphase_scope implementation *
+     *******************************/
+
+    xphase_scope::xphase_scope(xcell_phase phase)
+        : m_active(get_cell_profiler().is_profiling())
+        , m_previous(xcell_phase::execute)
+    {
+        if (m_active)
+        {
+            m_previous = get_cell_profiler().switch_phase(phase);
+        }
+    }
+
+    xphase_scope::~xphase_scope()
+    {
+        if (m_active)
+        {
+            get_cell_profiler().switch_phase(m_previous);
+        }
+    }
+}
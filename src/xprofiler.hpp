@@ -0,0 +1,115 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_PROFILER_HPP
+#define XPYT_PROFILER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    // Phases of the execution of a cell. The time of a cell that is not
+    // spent in one of the other phases is accounted to execute.
+    enum class xcell_phase
+    {
+        transform,
+        compile,
+        execute,
+        format,
+        publish,
+        payload
+    };
+
+    constexpr std::size_t cell_phase_count = 6;
+
+    /******************************
+     * xcell_profiler declaration *
+     ******************************/
+
+    /**
+     * Measures the time spent in each phase of the execution of a cell. The
+     * phases nest: the time of a phase does not include the time of the
+     * phases entered from it. Only the thread executing the cell is
+     * measured.
+     */
+    class xcell_profiler
+    {
+    public:
+
+        using clock_type = std::chrono::steady_clock;
+
+        xcell_profiler();
+
+        bool enabled() const;
+        void set_enabled(bool enabled);
+
+        // Starts the profile of a cell executed by the calling thread
+        void start_cell();
+
+        // Ends the profile of the current cell and returns the time spent
+        // in each phase, in seconds
+        nl::json end_cell();
+
+        // True between start_cell and end_cell, on the thread executing the
+        // cell
+        bool is_profiling() const;
+
+        const nl::json& last_profile() const;
+
+        // Returns the phase that was current
+        xcell_phase switch_phase(xcell_phase phase);
+
+    private:
+
+        bool m_enabled;
+        std::atomic<bool> m_running;
+        std::thread::id m_thread;
+
+        xcell_phase m_phase;
+        clock_type::time_point m_phase_start;
+        clock_type::time_point m_cell_start;
+        std::array<clock_type::duration, cell_phase_count> m_durations;
+
+        nl::json m_last_profile;
+    };
+
+    xcell_profiler& get_cell_profiler();
+
+    /****************************
+     * xphase_scope declaration *
+     ****************************/
+
+    // Accounts the time of its scope to a phase of the cell being profiled
+    class xphase_scope
+    {
+    public:
+
+        explicit xphase_scope(xcell_phase phase);
+        ~xphase_scope();
+
+        xphase_scope(const xphase_scope&) = delete;
+        xphase_scope& operator=(const xphase_scope&) = delete;
+
+    private:
+
+        bool m_active;
+        xcell_phase m_previous;
+    };
+}
+
+#endif
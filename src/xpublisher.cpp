@@ -0,0 +1,509 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xinterpreter.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xeus-python/xoptions.hpp"
+
+#include "xcomm.hpp"
+#include "xfd_capture.hpp"
+#include "xmetrics.hpp"
+#include "xprofiler.hpp"
+#include "xpublisher.hpp"
+#include "xstore.hpp"
+#include "xstream.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        std::string get_display_id(const nl::json& transient)
+        {
+            if (transient.is_object())
+            {
+                auto id = transient.find("display_id");
+                if (id != transient.end() && id->is_string())
+                {
+                    return id->get<std::string>();
+                }
+            }
+            return std::string();
+        }
+
+        // Bounds the memory used by the cells creating many display ids
+        constexpr std::size_t max_display_hash_count = 4096;
+
+        bool is_throttling()
+        {
+            return get_display_options().update_interval.count() != 0;
+        }
+
+        // Shortest interval after which an output held back must be sent,
+        // zero if nothing needs to be flushed periodically
+        std::chrono::milliseconds flush_period()
+        {
+            std::chrono::milliseconds period(0);
+            auto shorten = [&period](std::chrono::milliseconds interval)
+            {
+                if (interval.count() != 0 && (period.count() == 0 || interval < period))
+                {
+                    period = interval;
+                }
+            };
+
+            const xstream_options& options = get_stream_options();
+            if (options.buffer_size != 0)
+            {
+                shorten(options.flush_interval);
+            }
+            shorten(get_display_options().update_interval);
+            if (has_comm_updates())
+            {
+                shorten(get_comm_options().coalesce_interval);
+            }
+            return period;
+        }
+
+        // Size of the text entries of a display bundle, the others are
+        // only serialized when the message is sent
+        std::size_t bundle_size(const nl::json& data)
+        {
+            std::size_t size = 0;
+            if (data.is_object())
+            {
+                for (const auto& entry : data)
+                {
+                    if (entry.is_string())
+                    {
+                        size += entry.get_ref<const std::string&>().size();
+                    }
+                }
+            }
+            return size;
+        }
+    }
+
+    xpublisher::xpublisher()
+        : m_running(false)
+        , m_flush_scheduled(false)
+        , m_comm_update(false)
+    {
+    }
+
+    xpublisher::~xpublisher()
+    {
+        stop();
+    }
+
+    // The captured file descriptors schedule their flushes themselves, the
+    // comms coalescing their updates start the timer on their first update.
+    void xpublisher::start()
+    {
+        if (get_stream_options().buffer_size != 0 || is_throttling() || get_comm_options().coalesce_updates)
+        {
+            start_timer();
+        }
+    }
+
+    void xpublisher::start_timer()
+    {
+#ifndef XPYT_EMSCRIPTEN_WASM_BUILD
+        if (!m_running.load())
+        {
+            m_running.store(true);
+            m_thread = std::thread(&xpublisher::run, this);
+        }
+#endif
+    }
+
+    void xpublisher::stop()
+    {
+        if (m_running.load())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_running.store(false);
+            }
+            m_cv.notify_one();
+            m_thread.join();
+        }
+    }
+
+    void xpublisher::publish_stream(std::string name, std::string text)
+    {
+        xphase_scope phase(xcell_phase::publish);
+        get_metrics().record_publication(xpublication_kind::stream, text.size());
+        if (is_throttling())
+        {
+            // Text written inside a frame must not be reordered with its displays
+            std::lock_guard<std::mutex> lock(m_display_mutex);
+            send_display_frame();
+        }
+
+        send([name = std::move(name), text = std::move(text)]() mutable
+        {
+            xeus::get_interpreter().publish_stream(name, text);
+        });
+    }
+
+    void xpublisher::display_data(nl::json data, nl::json metadata, nl::json transient)
+    {
+        xphase_scope phase(xcell_phase::publish);
+        get_metrics().record_publication(xpublication_kind::display_data, bundle_size(data));
+        std::string id = get_display_id(transient);
+        record_display(id, data, metadata, false);
+        flush_comm_updates();
+        flush_streams();
+        task_type task = [data = std::move(data), metadata = std::move(metadata), transient = std::move(transient)]() mutable
+        {
+            externalize_bundle(data);
+            xeus::get_interpreter().display_data(std::move(data), std::move(metadata), std::move(transient));
+        };
+
+        if (!is_throttling())
+        {
+            send(std::move(task));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_display_mutex);
+        auto it = m_display_slots.find(id);
+        if (it != m_display_slots.end() && it->second.m_pending)
+        {
+            // The other outputs of this display id must show its last state
+            send_display_update(it->second, clock_type::now());
+        }
+
+        if (m_display_frame.m_pending)
+        {
+            m_display_frame.m_tasks.push_back(std::move(task));
+        }
+        else
+        {
+            send(std::move(task));
+        }
+    }
+
+    void xpublisher::update_display_data(nl::json data, nl::json metadata, nl::json transient)
+    {
+        xphase_scope phase(xcell_phase::publish);
+        bool throttling = is_throttling();
+        if (throttling)
+        {
+            flush_displays(true);
+        }
+
+        std::string id = get_display_id(transient);
+        if (!record_display(id, data, metadata, true))
+        {
+            return;
+        }
+        get_metrics().record_publication(xpublication_kind::update_display_data, bundle_size(data));
+        flush_comm_updates();
+        flush_streams();
+        task_type task = [data = std::move(data), metadata = std::move(metadata), transient = std::move(transient)]() mutable
+        {
+            externalize_bundle(data);
+            xeus::get_interpreter().update_display_data(std::move(data), std::move(metadata), std::move(transient));
+        };
+
+        if (!throttling || id.empty())
+        {
+            send(std::move(task));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_display_mutex);
+        auto now = clock_type::now();
+        display_slot& slot = m_display_slots[id];
+        if (now - slot.m_last_sent >= get_display_options().update_interval)
+        {
+            slot.m_last_sent = now;
+            send(std::move(task));
+        }
+        else
+        {
+            // Latest wins, the update held back until now is dropped
+            slot.m_pending = std::move(task);
+        }
+    }
+
+    void xpublisher::publish_execution_result(int execution_count, nl::json data, nl::json metadata)
+    {
+        xphase_scope phase(xcell_phase::publish);
+        get_metrics().record_publication(xpublication_kind::execute_result, bundle_size(data));
+        flush_comm_updates();
+        flush_streams();
+        if (is_throttling())
+        {
+            std::lock_guard<std::mutex> lock(m_display_mutex);
+            send_display_frame();
+        }
+
+        send([execution_count, data = std::move(data), metadata = std::move(metadata)]() mutable
+        {
+            externalize_bundle(data);
+            xeus::get_interpreter().publish_execution_result(execution_count, std::move(data), std::move(metadata));
+        });
+    }
+
+    void xpublisher::clear_output(bool wait)
+    {
+        xphase_scope phase(xcell_phase::publish);
+        get_metrics().record_publication(xpublication_kind::clear_output, 0);
+        flush_comm_updates();
+        flush_streams();
+        task_type task = [wait]()
+        {
+            xeus::get_interpreter().clear_output(wait);
+        };
+
+        if (!is_throttling())
+        {
+            send(std::move(task));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_display_mutex);
+        if (!wait)
+        {
+            send_display_frame();
+            send(std::move(task));
+            return;
+        }
+
+        // The frame held back until now is replaced by this one
+        m_display_frame.m_tasks.clear();
+        auto now = clock_type::now();
+        if (now - m_display_frame.m_last_sent >= get_display_options().update_interval)
+        {
+            m_display_frame.m_pending = false;
+            m_display_frame.m_last_sent = now;
+            send(std::move(task));
+        }
+        else
+        {
+            m_display_frame.m_pending = true;
+            m_display_frame.m_tasks.push_back(std::move(task));
+        }
+    }
+
+    void xpublisher::synchronize()
+    {
+        xphase_scope phase(xcell_phase::publish);
+        flush_comm_updates();
+        flush_streams();
+        if (is_throttling())
+        {
+            flush_displays(false);
+        }
+    }
+
+    void xpublisher::flush_due()
+    {
+        flush_due_comm_updates();
+        get_fd_capture().flush_due();
+        flush_stale_streams();
+        if (is_throttling())
+        {
+            flush_displays(true);
+        }
+    }
+
+    bool xpublisher::record_display(const std::string& display_id, const nl::json& data, const nl::json& metadata, bool update)
+    {
+        if (!get_display_options().deduplicate_updates || display_id.empty())
+        {
+            return true;
+        }
+
+        std::hash<nl::json> hasher;
+        std::size_t hash = hasher(data);
+        hash ^= hasher(metadata) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+        std::lock_guard<std::mutex> lock(m_display_mutex);
+        auto it = m_display_hash_index.find(display_id);
+        if (it == m_display_hash_index.end())
+        {
+            if (m_display_hashes.size() >= max_display_hash_count)
+            {
+                // The next update of the least recently used id is sent
+                m_display_hash_index.erase(m_display_hashes.back().first);
+                m_display_hashes.pop_back();
+            }
+            m_display_hashes.emplace_front(display_id, hash);
+            m_display_hash_index.emplace(display_id, m_display_hashes.begin());
+            return true;
+        }
+
+        m_display_hashes.splice(m_display_hashes.begin(), m_display_hashes, it->second);
+        std::size_t& last_hash = it->second->second;
+        // A new display is always sent, it creates a new output in the frontend
+        if (update && last_hash == hash)
+        {
+            return false;
+        }
+        last_hash = hash;
+        return true;
+    }
+
+    void xpublisher::flush_displays(bool due_only)
+    {
+        std::lock_guard<std::mutex> lock(m_display_mutex);
+        auto now = clock_type::now();
+        auto interval = get_display_options().update_interval;
+
+        if (!due_only || now - m_display_frame.m_last_sent >= interval)
+        {
+            send_display_frame();
+        }
+
+        for (auto it = m_display_slots.begin(); it != m_display_slots.end();)
+        {
+            bool due = now - it->second.m_last_sent >= interval;
+            if (it->second.m_pending && (due || !due_only))
+            {
+                send_display_update(it->second, now);
+                ++it;
+            }
+            else if (due)
+            {
+                // Nothing to hold back anymore
+                it = m_display_slots.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    void xpublisher::send_display_frame()
+    {
+        if (!m_display_frame.m_pending)
+        {
+            return;
+        }
+
+        for (task_type& task : m_display_frame.m_tasks)
+        {
+            send(std::move(task));
+        }
+        m_display_frame.m_tasks.clear();
+        m_display_frame.m_pending = false;
+        m_display_frame.m_last_sent = clock_type::now();
+    }
+
+    void xpublisher::send_display_update(display_slot& slot, clock_type::time_point now)
+    {
+        send(std::move(slot.m_pending));
+        slot.m_pending = nullptr;
+        slot.m_last_sent = now;
+    }
+
+    void xpublisher::send(task_type&& task)
+    {
+        task();
+    }
+
+    int xpublisher::flush_due_callback(void*)
+    {
+        xpublisher& publisher = get_publisher();
+        publisher.m_flush_scheduled.store(false);
+        try
+        {
+            publisher.flush_due();
+        }
+        catch (std::exception& e)
+        {
+            // std::clog may be captured, which would publish the error again
+            get_fd_capture().write_terminal(std::string("Error while publishing message: ") + e.what() + "\n");
+        }
+        return 0;
+    }
+
+    void xpublisher::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto woken = [this]() { return !m_running.load() || m_comm_update; };
+        while (m_running.load())
+        {
+            // Nothing is scheduled while no output can be held back
+            std::chrono::milliseconds period = flush_period();
+            if (period.count() == 0)
+            {
+                m_cv.wait(lock, woken);
+            }
+            else
+            {
+                m_cv.wait_for(lock, period, woken);
+            }
+            if (!m_running.load())
+            {
+                break;
+            }
+
+            if (m_comm_update)
+            {
+                // The timeout is computed again with the comm updates
+                m_comm_update = false;
+                continue;
+            }
+            schedule_flush();
+        }
+    }
+
+    void xpublisher::notify_comm_update()
+    {
+        if (!m_running.load())
+        {
+            start_timer();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_comm_update = true;
+        }
+        m_cv.notify_one();
+    }
+
+    // The flush runs on the main thread, which handles the shell requests.
+    // At most one flush is scheduled at a time, so that none accumulate
+    // while the kernel is idle.
+    void xpublisher::schedule_flush()
+    {
+        if (!m_flush_scheduled.exchange(true) && Py_AddPendingCall(&xpublisher::flush_due_callback, nullptr) != 0)
+        {
+            m_flush_scheduled.store(false);
+        }
+    }
+
+    xpublisher& get_publisher()
+    {
+        static xpublisher publisher;
+        return publisher;
+    }
+}
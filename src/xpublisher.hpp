@@ -0,0 +1,168 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_PUBLISHER_HPP
+#define XPYT_PUBLISHER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    /**
+     * xpublisher sends the outputs of the kernel (streams, displays,
+     * execution results) on the iopub channel.
+     *
+     * The messages are sent from the calling thread, which is the thread
+     * running the Python code, so that they are serialized with the other
+     * messages of the shell thread and carry the parent header of the
+     * request being handled.
+     *
+     * A timer thread sends nothing itself: it schedules the flush of the
+     * outputs held back for too long (buffered streams, throttled displays,
+     * coalesced comm updates) on the main thread, where it runs the next
+     * time the Python code checks for pending calls. The timer only runs
+     * when the options make outputs held back.
+     *
+     * The main thread only runs Python code while it handles a request.
+     * The outputs held back while the kernel is idle (written by threads
+     * or child processes after the end of a cell, throttled updates) are
+     * therefore sent during the next request, with its parent header.
+     *
+     * Messages that are not sent through the publisher (comm messages,
+     * input requests, execution errors) must be preceded by a call to
+     * synchronize() so that the order of the outputs is preserved.
+     *
+     * Unless disabled in the display options, the publisher keeps a hash
+     * of the last bundle sent for each display id, and drops the display
+     * updates identical to it. Only the most recently used display ids are
+     * remembered.
+     *
+     * When the display options set an update interval, the updates of a
+     * display id sent less than that interval after the previous one are
+     * held back, the latest one replacing the others, and sent when the
+     * interval has elapsed. The same applies to the frames drawn with
+     * clear_output(wait=True) followed by displays. The outputs held back
+     * are sent by synchronize().
+     *
+     * The entries of the display bundles larger than the store threshold
+     * of the display options are moved to the content store when the
+     * messages are sent.
+     */
+    class xpublisher
+    {
+    public:
+
+        using task_type = std::function<void()>;
+        using clock_type = std::chrono::steady_clock;
+
+        xpublisher();
+        ~xpublisher();
+
+        xpublisher(const xpublisher&) = delete;
+        xpublisher& operator=(const xpublisher&) = delete;
+
+        // Starts the timer thread if the options make outputs held back,
+        // and stops it
+        void start();
+        void stop();
+
+        void publish_stream(std::string name, std::string text);
+        void display_data(nl::json data, nl::json metadata, nl::json transient);
+        void update_display_data(nl::json data, nl::json metadata, nl::json transient);
+        void publish_execution_result(int execution_count, nl::json data, nl::json metadata);
+        void clear_output(bool wait);
+
+        // Sends the coalesced comm updates, the buffered streams and the
+        // throttled displays.
+        void synchronize();
+
+        // Sends the outputs held back for longer than their interval. Must
+        // be called from the main thread with the GIL held.
+        void flush_due();
+
+        // Schedules flush_due() on the main thread. Can be called from any
+        // thread, without the GIL.
+        void schedule_flush();
+
+        // Wakes the timer thread up, or starts it, so that it takes a new
+        // comm update held back into account
+        void notify_comm_update();
+
+    private:
+
+        void send(task_type&& task);
+        void start_timer();
+        void run();
+        static int flush_due_callback(void*);
+
+        // Last update of a display id and the update held back since then
+        struct display_slot
+        {
+            clock_type::time_point m_last_sent;
+            task_type m_pending;
+        };
+
+        // Last frame started by clear_output(wait=True), and the outputs of
+        // the frame held back since then
+        struct display_frame
+        {
+            clock_type::time_point m_last_sent;
+            bool m_pending = false;
+            std::vector<task_type> m_tasks;
+        };
+
+        // Returns false if the bundle is identical to the last one sent
+        // for the display id
+        bool record_display(const std::string& display_id, const nl::json& data, const nl::json& metadata, bool update);
+
+        // Sends the throttled displays, or only those whose interval has
+        // elapsed when due_only is true
+        void flush_displays(bool due_only);
+
+        // Must be called with m_display_mutex locked
+        void send_display_frame();
+        void send_display_update(display_slot& slot, clock_type::time_point now);
+
+        std::atomic<bool> m_running;
+        std::atomic<bool> m_flush_scheduled;
+        bool m_comm_update;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::thread m_thread;
+
+        std::mutex m_display_mutex;
+        // Display ids and hashes of their last bundle, most recently used
+        // first
+        using display_hash_list = std::list<std::pair<std::string, std::size_t>>;
+        display_hash_list m_display_hashes;
+        std::unordered_map<std::string, display_hash_list::iterator> m_display_hash_index;
+        std::unordered_map<std::string, display_slot> m_display_slots;
+        display_frame m_display_frame;
+    };
+
+    xpublisher& get_publisher();
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include "xeus-python/xinterpreter.hpp"
 #include "xeus-python/xinterpreter_raw.hpp"
 #include "xeus-python/xdebugger.hpp"
+#include "xeus-python/xoptions.hpp"
 #include "xeus-python/xutils.hpp"
 
 namespace py = pybind11;
@@ -66,6 +67,7 @@ void launch(const py::list args_list)
 
     bool raw_mode = xpyt::extract_option("-r", "--raw", argc, argv.data());
     std::string connection_filename = xpyt::extract_parameter("-f", argc, argv.data());
+    xpyt::extract_kernel_options(argc, argv.data());
 
     using context_type = xeus::xcontext_impl<zmq::context_t>;
     using context_ptr = std::unique_ptr<context_type>;
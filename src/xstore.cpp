@@ -0,0 +1,510 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus/xcomm.hpp"
+#include "xeus/xinterpreter.hpp"
+#include "xeus/xsystem.hpp"
+
+#include "xeus-python/xoptions.hpp"
+
+#include "xinternal_utils.hpp"
+#include "xmetrics.hpp"
+#include "xpublisher.hpp"
+#include "xstore.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    const char* store_reference_mimetype = "application/vnd.xeus-python.store+json";
+    const char* store_target_name = "xeus-python.store";
+
+    /***********
+     * SHA-256 *
+     ***********/
+
+    namespace
+    {
+        const std::uint32_t sha256_constants[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        inline std::uint32_t rotate_right(std::uint32_t x, int n)
+        {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        void sha256_block(std::uint32_t* state, const unsigned char* block)
+        {
+            std::uint32_t w[64];
+            for (int i = 0; i < 16; ++i)
+            {
+                w[i] = (std::uint32_t(block[4 * i]) << 24) | (std::uint32_t(block[4 * i + 1]) << 16)
+                     | (std::uint32_t(block[4 * i + 2]) << 8) | std::uint32_t(block[4 * i + 3]);
+            }
+            for (int i = 16; i < 64; ++i)
+            {
+                std::uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                std::uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; ++i)
+            {
+                std::uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+                std::uint32_t ch = (e & f) ^ (~e & g);
+                std::uint32_t t1 = h + s1 + ch + sha256_constants[i] + w[i];
+                std::uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+                std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+                std::uint32_t t2 = s0 + maj;
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+    }
+
+    std::string sha256_hex(const char* data, std::size_t size)
+    {
+        std::uint32_t state[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        std::size_t full_size = size - size % 64;
+        for (std::size_t i = 0; i < full_size; i += 64)
+        {
+            sha256_block(state, bytes + i);
+        }
+
+        // Padding: a one bit, zeros, and the length in bits on 64 bits
+        unsigned char tail[128] = {0};
+        std::size_t rest = size - full_size;
+        if (rest != 0)
+        {
+            std::memcpy(tail, bytes + full_size, rest);
+        }
+        tail[rest] = 0x80;
+        std::size_t tail_size = rest + 9 <= 64 ? 64 : 128;
+        std::uint64_t bit_size = std::uint64_t(size) * 8;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            tail[tail_size - 1 - i] = static_cast<unsigned char>(bit_size >> (8 * i));
+        }
+        for (std::size_t i = 0; i < tail_size; i += 64)
+        {
+            sha256_block(state, tail + i);
+        }
+
+        static const char digits[] = "0123456789abcdef";
+        std::string res(64, '0');
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            for (std::size_t j = 0; j < 8; ++j)
+            {
+                res[8 * i + j] = digits[(state[i] >> (28 - 4 * j)) & 0xf];
+            }
+        }
+        return res;
+    }
+
+    /*********************************
+     * xcontent_store implementation *
+     *********************************/
+
+    namespace
+    {
+        bool is_valid_key(const std::string& key)
+        {
+            if (key.size() != 64)
+            {
+                return false;
+            }
+            for (char c : key)
+            {
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool read_file(const std::string& file_path, std::vector<char>& content)
+        {
+            std::ifstream file(file_path, std::ios::binary);
+            if (!file)
+            {
+                return false;
+            }
+            content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            return !file.bad();
+        }
+
+        // Returns false if the file cannot be opened
+        bool file_size(const std::string& file_path, std::size_t& size)
+        {
+            std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+            if (!file)
+            {
+                return false;
+            }
+            size = static_cast<std::size_t>(file.tellg());
+            return true;
+        }
+
+        // The files of the store are only trusted if their content matches
+        // their name
+        bool has_content(const std::string& file_path, const std::string& key, std::size_t size)
+        {
+            std::size_t actual_size = 0;
+            std::vector<char> content;
+            return file_size(file_path, actual_size) && actual_size == size
+                && read_file(file_path, content) && sha256_hex(content.data(), content.size()) == key;
+        }
+
+        std::string get_environment(const char* name)
+        {
+            const char* value = std::getenv(name);
+            return value != nullptr ? std::string(value) : std::string();
+        }
+
+        // Runtime directory of Jupyter, computed like jupyter_core does,
+        // or an empty string if it cannot be found
+        std::string jupyter_runtime_directory()
+        {
+            std::string runtime = get_environment("JUPYTER_RUNTIME_DIR");
+            if (!runtime.empty())
+            {
+                return runtime;
+            }
+
+            std::string data = get_environment("JUPYTER_DATA_DIR");
+            if (data.empty())
+            {
+#if defined(_WIN32)
+                std::string appdata = get_environment("APPDATA");
+                data = appdata.empty() ? std::string() : appdata + "/jupyter";
+#elif defined(__APPLE__)
+                std::string home = get_environment("HOME");
+                data = home.empty() ? std::string() : home + "/Library/Jupyter";
+#else
+                std::string xdg_data = get_environment("XDG_DATA_HOME");
+                std::string home = get_environment("HOME");
+                if (!xdg_data.empty())
+                {
+                    data = xdg_data + "/jupyter";
+                }
+                else if (!home.empty())
+                {
+                    data = home + "/.local/share/jupyter";
+                }
+#endif
+            }
+            return data.empty() ? std::string() : data + "/runtime";
+        }
+
+        std::string default_store_directory()
+        {
+            std::string runtime = jupyter_runtime_directory();
+            if (!runtime.empty())
+            {
+                return runtime + "/xpython_store";
+            }
+#ifdef _WIN32
+            return xeus::get_temp_directory_path() + "/xpython_store";
+#else
+            return xeus::get_temp_directory_path() + "/xpython_store-" + std::to_string(getuid());
+#endif
+        }
+
+        // Replaces the file atomically, so that the kernels sharing the
+        // store never read a partial content
+        bool write_file(const std::string& file_path, const std::string& content)
+        {
+            std::string temp_path = file_path + "." + std::to_string(xeus::get_current_pid()) + ".tmp";
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            file.write(content.data(), static_cast<std::streamsize>(content.size()));
+            file.close();
+            if (!file)
+            {
+                std::remove(temp_path.c_str());
+                return false;
+            }
+            if (std::rename(temp_path.c_str(), file_path.c_str()) != 0)
+            {
+                // rename does not replace an existing file on Windows
+                std::remove(file_path.c_str());
+                if (std::rename(temp_path.c_str(), file_path.c_str()) != 0)
+                {
+                    std::remove(temp_path.c_str());
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    xcontent_store::xcontent_store(std::string directory)
+        : m_directory(std::move(directory))
+        , m_directory_checked(false)
+        , m_directory_valid(false)
+    {
+    }
+
+    std::string xcontent_store::put(const std::string& content)
+    {
+        std::string key = sha256_hex(content.data(), content.size());
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_directory_checked)
+        {
+            m_directory_valid = create_private_directory(m_directory);
+            m_directory_checked = true;
+        }
+        if (!m_directory_valid)
+        {
+            return std::string();
+        }
+
+        std::string file_path = path(key);
+        std::size_t size = 0;
+        if (m_keys.count(key) != 0)
+        {
+            // The file may have been removed since, by a cleaner of the
+            // temporary directory for instance
+            if (file_size(file_path, size) && size == content.size())
+            {
+                return key;
+            }
+        }
+        else if (has_content(file_path, key, content.size()))
+        {
+            m_keys.insert(key);
+            return key;
+        }
+
+        if (!write_file(file_path, content))
+        {
+            // Another kernel may have stored the same content in the meantime
+            m_keys.erase(key);
+            if (!has_content(file_path, key, content.size()))
+            {
+                return std::string();
+            }
+        }
+
+        m_keys.insert(key);
+        return key;
+    }
+
+    bool xcontent_store::get(const std::string& key, std::vector<char>& content) const
+    {
+        if (!is_valid_key(key))
+        {
+            return false;
+        }
+
+        // The file may have been modified since it was written
+        return read_file(path(key), content) && sha256_hex(content.data(), content.size()) == key;
+    }
+
+    const std::string& xcontent_store::directory() const
+    {
+        return m_directory;
+    }
+
+    std::string xcontent_store::path(const std::string& key) const
+    {
+        return m_directory + "/" + key;
+    }
+
+    xcontent_store& get_content_store()
+    {
+        static xcontent_store store(
+            get_display_options().store_directory.empty()
+                ? default_store_directory()
+                : get_display_options().store_directory
+        );
+        return store;
+    }
+
+    /****************************
+     * display bundles handling *
+     ****************************/
+
+    namespace
+    {
+        constexpr std::size_t preview_size = 1024;
+
+        // Truncates on a character boundary of the UTF-8 text
+        std::string make_preview(const std::string& text)
+        {
+            if (text.size() <= preview_size)
+            {
+                return text;
+            }
+            std::size_t size = preview_size;
+            while (size > 0 && (static_cast<unsigned char>(text[size]) & 0xC0) == 0x80)
+            {
+                --size;
+            }
+            return text.substr(0, size) + "...";
+        }
+    }
+
+    void externalize_bundle(nl::json& data)
+    {
+        std::size_t threshold = get_display_options().store_threshold;
+        if (threshold == 0 || !data.is_object())
+        {
+            return;
+        }
+
+        nl::json references = nl::json::object();
+        for (auto it = data.begin(); it != data.end(); ++it)
+        {
+            bool is_text = it->is_string();
+            if (is_text && it->get_ref<const std::string&>().size() <= threshold)
+            {
+                continue;
+            }
+
+            std::string content = is_text ? it->get_ref<const std::string&>() : it->dump();
+            if (content.size() <= threshold)
+            {
+                continue;
+            }
+
+            std::string key = get_content_store().put(content);
+            if (key.empty())
+            {
+                // The entry is sent inline when it cannot be stored
+                continue;
+            }
+
+            nl::json reference = {
+                { "key", key },
+                { "size", content.size() },
+                { "encoding", is_text ? "text" : "json" }
+            };
+            if (is_text)
+            {
+                reference["preview"] = make_preview(content);
+            }
+            references[it.key()] = std::move(reference);
+        }
+
+        if (references.empty())
+        {
+            return;
+        }
+
+        // The frontends unaware of the store display the text/plain entry
+        std::string plain_text;
+        auto plain_reference = references.find("text/plain");
+        if (plain_reference != references.end())
+        {
+            plain_text = (*plain_reference)["preview"].get<std::string>() + "\n";
+        }
+        for (auto it = references.begin(); it != references.end(); ++it)
+        {
+            data.erase(it.key());
+            plain_text += "[" + it.key() + ", " + std::to_string((*it)["size"].get<std::size_t>())
+                        + " bytes in the display store]\n";
+        }
+        if (!data.contains("text/plain"))
+        {
+            plain_text.pop_back();
+            data["text/plain"] = std::move(plain_text);
+        }
+        data[store_reference_mimetype] = std::move(references);
+    }
+
+    /*********************
+     * store comm target *
+     *********************/
+
+    // The comm is opened with the list of the keys to fetch. Each content
+    // is sent in a message of its own, as a binary buffer, and the comm
+    // is closed once they are all sent.
+    void register_store_target()
+    {
+        auto callback = [](xeus::xcomm&& comm, const xeus::xmessage& msg)
+        {
+            xrequest_metric metric(xrequest_kind::comm_open, 0);
+            nl::json data = msg.content().value("data", nl::json::object());
+            nl::json keys = data.is_object() ? data.value("keys", nl::json::array()) : nl::json::array();
+
+            get_publisher().synchronize();
+            const xcontent_store& store = get_content_store();
+            for (const nl::json& key : keys)
+            {
+                if (!key.is_string())
+                {
+                    continue;
+                }
+
+                std::vector<char> content;
+                bool found = store.get(key.get<std::string>(), content);
+                xeus::buffer_sequence buffers;
+                if (found)
+                {
+                    buffers.push_back(std::move(content));
+                }
+                comm.send(nl::json::object(), nl::json({ { "key", key }, { "found", found } }), std::move(buffers));
+            }
+            comm.close(nl::json::object(), nl::json::object(), xeus::buffer_sequence());
+        };
+
+        xeus::get_interpreter().comm_manager().register_comm_target(store_target_name, callback);
+    }
+}
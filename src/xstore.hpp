@@ -0,0 +1,85 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_STORE_HPP
+#define XPYT_STORE_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    // Mimetype of the references to the store in the display bundles
+    extern const char* store_reference_mimetype;
+
+    // Name of the comm target serving the content of the store
+    extern const char* store_target_name;
+
+    // Hexadecimal SHA-256 digest of a buffer
+    std::string sha256_hex(const char* data, std::size_t size);
+
+    /******************************
+     * xcontent_store declaration *
+     ******************************/
+
+    /**
+     * Store of the display payloads too large to be sent inline, one file
+     * per content named after its SHA-256 digest. Identical contents are
+     * stored once, and the store can be shared by the kernels of a user.
+     *
+     * The directory must belong to the current user and not be writable
+     * by others, nothing is stored otherwise. The files found in the store
+     * are checked against their digest before being used or sent.
+     */
+    class xcontent_store
+    {
+    public:
+
+        explicit xcontent_store(std::string directory);
+
+        // Stores the content if it is not already, and returns its key
+        std::string put(const std::string& content);
+
+        // Returns false if the key is invalid or not in the store
+        bool get(const std::string& key, std::vector<char>& content) const;
+
+        const std::string& directory() const;
+
+    private:
+
+        std::string path(const std::string& key) const;
+
+        std::string m_directory;
+        std::mutex m_mutex;
+        // Keys of the contents this kernel has written or checked
+        std::unordered_set<std::string> m_keys;
+        bool m_directory_checked;
+        bool m_directory_valid;
+    };
+
+    xcontent_store& get_content_store();
+
+    // Replaces the entries of a display bundle larger than the store
+    // threshold of the display options with references to the store.
+    void externalize_bundle(nl::json& data);
+
+    // Registers the comm target through which the frontend fetches the
+    // content of the store.
+    void register_store_target();
+}
+
+#endif
@@ -8,22 +8,210 @@
 * The full license is in the file LICENSE, distributed with this software. *
 ****************************************************************************/
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 #include "xeus/xinterpreter.hpp"
+#include "xeus/xsystem.hpp"
 
 #include "pybind11/functional.h"
 #include "pybind11/pybind11.h"
 
-#include "xstream.hpp"
+#include "xeus-python/xoptions.hpp"
+
+#include "xcomm.hpp"
+#include "xfd_capture.hpp"
 #include "xinternal_utils.hpp"
+#include "xpublisher.hpp"
+#include "xstream.hpp"
+#include "xstream_compaction.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 namespace py = pybind11;
 
 namespace xpyt
 {
+    /*******************************
+     * xoutput_limiter declaration *
+     *******************************/
+
+    namespace
+    {
+        // The spill files are written in a directory private to the user,
+        // where other users cannot plant links to files they would be
+        // overwritten through
+        std::string spill_directory()
+        {
+#ifdef _WIN32
+            return xeus::get_temp_directory_path() + "/xpython_output";
+#else
+            return xeus::get_temp_directory_path() + "/xpython_output-" + std::to_string(getuid());
+#endif
+        }
+    }
+
+    // Accounts for the stream output sent during the execution of a cell.
+    // Past the limits of the stream options, the output is written to a
+    // spill file instead of being sent to the frontend.
+    class xoutput_limiter
+    {
+    public:
+
+        void reset();
+        void publish(const std::string& name, std::string text);
+        void report();
+
+    private:
+
+        void spill(const char* data, std::size_t size);
+
+        std::mutex m_mutex;
+        std::size_t m_cell_count = 0;
+        std::size_t m_bytes = 0;
+        std::size_t m_messages = 0;
+        std::size_t m_spilled_bytes = 0;
+        bool m_truncated = false;
+        std::string m_spill_path;
+        std::ofstream m_spill_file;
+    };
+
+    /**********************************
+     * xoutput_limiter implementation *
+     **********************************/
+
+    void xoutput_limiter::reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_cell_count;
+        m_bytes = 0;
+        m_messages = 0;
+        m_spilled_bytes = 0;
+        m_truncated = false;
+        m_spill_path.clear();
+        if (m_spill_file.is_open())
+        {
+            m_spill_file.close();
+        }
+    }
+
+    void xoutput_limiter::publish(const std::string& name, std::string text)
+    {
+        const xstream_options& options = get_stream_options();
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (!m_truncated && options.max_cell_messages != 0 && m_messages >= options.max_cell_messages)
+        {
+            m_truncated = true;
+        }
+        if (m_truncated)
+        {
+            spill(text.data(), text.size());
+            return;
+        }
+
+        if (options.max_cell_bytes != 0 && m_bytes + text.size() > options.max_cell_bytes)
+        {
+            // Do not cut a UTF-8 character in two
+            std::size_t size = options.max_cell_bytes - m_bytes;
+            while (size != 0 && (static_cast<unsigned char>(text[size]) & 0xC0) == 0x80)
+            {
+                --size;
+            }
+            spill(text.data() + size, text.size() - size);
+            text.resize(size);
+            m_truncated = true;
+            if (text.empty())
+            {
+                return;
+            }
+        }
+
+        m_bytes += text.size();
+        ++m_messages;
+        lock.unlock();
+        get_publisher().publish_stream(name, std::move(text));
+    }
+
+    void xoutput_limiter::report()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_spilled_bytes == 0)
+        {
+            return;
+        }
+
+        std::ostringstream message;
+        message << "\nOutput truncated: the output of this cell exceeded the limits of the kernel, "
+                << m_spilled_bytes << " more bytes ";
+        if (m_spill_file.is_open())
+        {
+            m_spill_file.flush();
+            message << "were written to " << m_spill_path << "\n";
+        }
+        else
+        {
+            message << "were discarded\n";
+        }
+        m_spilled_bytes = 0;
+        lock.unlock();
+        get_publisher().publish_stream("stderr", message.str());
+    }
+
+    // The mutex must be held by the caller.
+    void xoutput_limiter::spill(const char* data, std::size_t size)
+    {
+        if (!m_spill_file.is_open() && m_spill_path.empty())
+        {
+            std::string directory = spill_directory();
+            m_spill_path = directory + "/" + std::to_string(xeus::get_current_pid())
+                + "_" + std::to_string(m_cell_count) + ".log";
+            if (create_private_directory(directory))
+            {
+                m_spill_file.open(m_spill_path, std::ios::binary | std::ios::trunc);
+            }
+        }
+        if (m_spill_file.is_open())
+        {
+            m_spill_file.write(data, static_cast<std::streamsize>(size));
+        }
+        m_spilled_bytes += size;
+    }
+
+    xoutput_limiter& get_output_limiter()
+    {
+        static xoutput_limiter limiter;
+        return limiter;
+    }
+
+    void publish_stream_output(const std::string& name, std::string text)
+    {
+        if (get_stream_options().compact_output)
+        {
+            text = compact_stream_output(text);
+        }
+        get_output_limiter().publish(name, std::move(text));
+    }
+
+    void reset_output_limits()
+    {
+        get_output_limiter().reset();
+    }
+
+    void report_truncated_output()
+    {
+        flush_streams();
+        get_output_limiter().report();
+    }
 
     /***********************
      * xstream declaration *
@@ -33,38 +221,106 @@ namespace xpyt
     {
     public:
 
+        using clock_type = std::chrono::steady_clock;
+
         xstream(std::string stream_name);
         virtual ~xstream();
 
         void write(const std::string& message);
         void flush();
+        void flush_if_stale();
         bool isatty();
 
     private:
 
+        void publish_buffer();
+
         std::string m_stream_name;
+        std::string m_buffer;
+        clock_type::time_point m_buffer_start;
+        std::mutex m_mutex;
     };
 
     /**************************
      * xstream implementation *
      **************************/
 
+    // Registry of the alive streams, used to flush the buffered
+    // output before other messages are published.
+    std::vector<xstream*>& get_stream_registry()
+    {
+        static std::vector<xstream*> registry;
+        return registry;
+    }
+
+    std::mutex& get_stream_registry_mutex()
+    {
+        static std::mutex registry_mutex;
+        return registry_mutex;
+    }
+
     xstream::xstream(std::string stream_name)
         : m_stream_name(stream_name)
     {
+        std::lock_guard<std::mutex> lock(get_stream_registry_mutex());
+        get_stream_registry().push_back(this);
     }
 
     xstream::~xstream()
     {
+        flush();
+        std::lock_guard<std::mutex> lock(get_stream_registry_mutex());
+        auto& registry = get_stream_registry();
+        registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
     }
 
     void xstream::write(const std::string& message)
     {
-        xeus::get_interpreter().publish_stream(m_stream_name, message);
+        // The widget updates sent before this output must be sent first,
+        // e.g. for the Output widget to capture it.
+        flush_comm_updates();
+
+        const xstream_options& options = get_stream_options();
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_buffer.empty())
+        {
+            m_buffer_start = clock_type::now();
+        }
+        m_buffer += message;
+
+        if (m_buffer.size() >= options.buffer_size ||
+            clock_type::now() - m_buffer_start >= options.flush_interval)
+        {
+            publish_buffer();
+        }
     }
 
     void xstream::flush()
     {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        publish_buffer();
+    }
+
+    void xstream::flush_if_stale()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (clock_type::now() - m_buffer_start >= get_stream_options().flush_interval)
+        {
+            publish_buffer();
+        }
+    }
+
+    // The mutex must be held by the caller, so that concurrent writers
+    // cannot reorder the published chunks.
+    void xstream::publish_buffer()
+    {
+        if (!m_buffer.empty())
+        {
+            std::string text;
+            std::swap(text, m_buffer);
+            publish_stream_output(m_stream_name, std::move(text));
+        }
     }
 
     bool xstream::isatty()
@@ -101,13 +357,33 @@ namespace xpyt
 
     void xterminal_stream::write(const std::string& message)
     {
-        std::cout << message;
+        get_fd_capture().write_terminal(message);
     }
 
     void xterminal_stream::flush()
     {
     }
 
+    void flush_streams()
+    {
+        get_fd_capture().flush();
+
+        std::lock_guard<std::mutex> lock(get_stream_registry_mutex());
+        for (xstream* stream : get_stream_registry())
+        {
+            stream->flush();
+        }
+    }
+
+    void flush_stale_streams()
+    {
+        std::lock_guard<std::mutex> lock(get_stream_registry_mutex());
+        for (xstream* stream : get_stream_registry())
+        {
+            stream->flush_if_stale();
+        }
+    }
+
     /*****************
      * stream module *
      *****************/
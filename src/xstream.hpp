@@ -11,6 +11,8 @@
 #ifndef XPYT_STREAM_HPP
 #define XPYT_STREAM_HPP
 
+#include <string>
+
 #include "pybind11/pybind11.h"
 
 namespace py = pybind11;
@@ -18,6 +20,27 @@ namespace py = pybind11;
 namespace xpyt
 {
     py::module get_stream_module();
+
+    // Sends the output buffered by the Stream objects and the output
+    // written to the captured file descriptors to the frontend.
+    // This must be called before publishing any other message so that
+    // the order of the outputs is preserved.
+    void flush_streams();
+
+    // Sends stream output to the frontend, compacted and within the per-cell
+    // output limits; the output exceeding the limits is written to a spill file.
+    void publish_stream_output(const std::string& name, std::string text);
+
+    // Starts the accounting of the output of a new cell.
+    void reset_output_limits();
+
+    // Flushes the streams and sends a summary of the output of the
+    // current cell that exceeded the limits, if any.
+    void report_truncated_output();
+
+    // Sends the output that has been buffered for longer than
+    // the flush interval. This can be called without the GIL.
+    void flush_stale_streams();
 }
 
 #endif
@@ -0,0 +1,151 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+#include "xstream_compaction.hpp"
+
+namespace xpyt
+{
+    namespace
+    {
+        // Returns the position after the n-th UTF-8 character of text
+        // starting at first, or last if text is shorter.
+        std::size_t advance_characters(const std::string& text, std::size_t first, std::size_t last, std::size_t n)
+        {
+            while (first != last && n != 0)
+            {
+                ++first;
+                while (first != last && (static_cast<unsigned char>(text[first]) & 0xC0) == 0x80)
+                {
+                    ++first;
+                }
+                --n;
+            }
+            return first;
+        }
+
+        std::size_t count_characters(const std::string& text, std::size_t first, std::size_t last)
+        {
+            std::size_t count = 0;
+            for (; first != last; ++first)
+            {
+                if ((static_cast<unsigned char>(text[first]) & 0xC0) != 0x80)
+                {
+                    ++count;
+                }
+            }
+            return count;
+        }
+
+        // Replaces runs of identical erase in line sequences with a single one
+        void collapse_erase_sequences(std::string& text)
+        {
+            static const std::array<std::string, 3> sequences = {{ "\x1b[K", "\x1b[0K", "\x1b[2K" }};
+            for (const std::string& sequence : sequences)
+            {
+                std::string repeated = sequence + sequence;
+                std::size_t pos = text.find(repeated);
+                while (pos != std::string::npos)
+                {
+                    text.erase(pos + sequence.size(), sequence.size());
+                    pos = text.find(repeated, pos);
+                }
+            }
+        }
+    }
+
+    std::string fold_carriage_returns(const std::string& text, std::size_t first, std::size_t last)
+    {
+        std::string line;
+        std::size_t segment_start = first;
+        while (segment_start <= last)
+        {
+            std::size_t segment_end = text.find('\r', segment_start);
+            if (segment_end == std::string::npos || segment_end > last)
+            {
+                segment_end = last;
+            }
+            std::size_t overwritten = count_characters(text, segment_start, segment_end);
+            std::size_t kept = advance_characters(line, 0, line.size(), overwritten);
+            line = text.substr(segment_start, segment_end - segment_start) + line.substr(kept);
+            segment_start = segment_end + 1;
+        }
+        return line;
+    }
+
+    std::string compact_stream_output(const std::string& text)
+    {
+        if (text.find('\r') == std::string::npos)
+        {
+            std::string res = text;
+            collapse_erase_sequences(res);
+            return res;
+        }
+
+        std::string res;
+        res.reserve(text.size());
+        std::size_t line_start = 0;
+        bool first_line = true;
+        while (line_start <= text.size())
+        {
+            std::size_t line_end = text.find('\n', line_start);
+            bool last_line = line_end == std::string::npos;
+            if (last_line)
+            {
+                line_end = text.size();
+            }
+
+            // A carriage return followed by a newline is a no-op
+            std::size_t content_end = line_end;
+            while (!last_line && content_end != line_start && text[content_end - 1] == '\r')
+            {
+                --content_end;
+            }
+
+            std::size_t first_cr = text.find('\r', line_start);
+            if (first_cr == std::string::npos || first_cr >= content_end)
+            {
+                res.append(text, line_start, content_end - line_start);
+            }
+            else if (first_line)
+            {
+                // The beginning of the line may have been sent in a previous
+                // message, the first carriage return must be kept.
+                res.append(text, line_start, first_cr - line_start);
+                res += '\r';
+                res += fold_carriage_returns(text, first_cr + 1, content_end);
+            }
+            else
+            {
+                res += fold_carriage_returns(text, line_start, content_end);
+            }
+
+            // A trailing carriage return overwrites the next message
+            if (last_line && content_end != line_start && text[content_end - 1] == '\r' && res.back() != '\r')
+            {
+                res += '\r';
+            }
+
+            if (last_line)
+            {
+                break;
+            }
+            res += '\n';
+            line_start = line_end + 1;
+            first_line = false;
+        }
+
+        collapse_erase_sequences(res);
+        return res;
+    }
+}
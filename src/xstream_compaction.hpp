@@ -0,0 +1,30 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_STREAM_COMPACTION_HPP
+#define XPYT_STREAM_COMPACTION_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace xpyt
+{
+    // Folds the carriage returns of the line [first, last) of text the way
+    // the frontends do: each segment following a '\r' overwrites the
+    // beginning of the line. The line must not contain a newline.
+    std::string fold_carriage_returns(const std::string& text, std::size_t first, std::size_t last);
+
+    // Removes the parts of text that are overwritten by carriage returns
+    // and repeated erase in line sequences, so that only the visible final
+    // state of each line remains.
+    std::string compact_stream_output(const std::string& text);
+}
+
+#endif
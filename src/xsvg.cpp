@@ -0,0 +1,174 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <cstring>
+
+#include "xsvg.hpp"
+
+namespace xpyt
+{
+    namespace
+    {
+        const std::size_t npos = static_cast<std::size_t>(-1);
+
+        bool starts_with(const char* data, std::size_t size, std::size_t pos, const char* prefix)
+        {
+            std::size_t length = std::strlen(prefix);
+            return pos + length <= size && std::memcmp(data + pos, prefix, length) == 0;
+        }
+
+        // Position following the first occurrence of pattern at or after pos
+        std::size_t skip_past(const char* data, std::size_t size, std::size_t pos, const char* pattern)
+        {
+            std::size_t length = std::strlen(pattern);
+            while (pos + length <= size)
+            {
+                const void* found = std::memchr(data + pos, pattern[0], size - pos - length + 1);
+                if (found == nullptr)
+                {
+                    return npos;
+                }
+                pos = static_cast<std::size_t>(static_cast<const char*>(found) - data);
+                if (std::memcmp(data + pos, pattern, length) == 0)
+                {
+                    return pos + length;
+                }
+                ++pos;
+            }
+            return npos;
+        }
+
+        bool is_name_end(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '>' || c == '/';
+        }
+
+        // Position following the '>' closing the tag starting at pos, taking
+        // quoted attribute values into account. self_closing is set when the
+        // tag ends with "/>".
+        std::size_t skip_tag(const char* data, std::size_t size, std::size_t pos, bool& self_closing)
+        {
+            char quote = 0;
+            for (; pos < size; ++pos)
+            {
+                char c = data[pos];
+                if (quote != 0)
+                {
+                    if (c == quote)
+                    {
+                        quote = 0;
+                    }
+                }
+                else if (c == '"' || c == '\'')
+                {
+                    quote = c;
+                }
+                else if (c == '>')
+                {
+                    self_closing = data[pos - 1] == '/';
+                    return pos + 1;
+                }
+            }
+            return npos;
+        }
+
+        bool is_svg_name(const char* data, std::size_t size, std::size_t pos)
+        {
+            return starts_with(data, size, pos, "svg") && pos + 3 < size && is_name_end(data[pos + 3]);
+        }
+    }
+
+    bool find_svg_element(const char* data, std::size_t size, std::size_t& begin, std::size_t& end)
+    {
+        std::size_t depth = 0;
+        std::size_t pos = 0;
+        while (pos < size)
+        {
+            const void* found = std::memchr(data + pos, '<', size - pos);
+            if (found == nullptr)
+            {
+                return false;
+            }
+            pos = static_cast<std::size_t>(static_cast<const char*>(found) - data);
+
+            if (starts_with(data, size, pos, "<!--"))
+            {
+                pos = skip_past(data, size, pos + 4, "-->");
+            }
+            else if (starts_with(data, size, pos, "<![CDATA["))
+            {
+                pos = skip_past(data, size, pos + 9, "]]>");
+            }
+            else if (starts_with(data, size, pos, "<?"))
+            {
+                pos = skip_past(data, size, pos + 2, "?>");
+            }
+            else if (starts_with(data, size, pos, "<!"))
+            {
+                // DOCTYPE, the internal subset can define entities
+                bool self_closing = false;
+                std::size_t tag_end = skip_tag(data, size, pos + 2, self_closing);
+                if (tag_end == npos || std::memchr(data + pos, '[', tag_end - pos) != nullptr)
+                {
+                    return false;
+                }
+                pos = tag_end;
+            }
+            else if (starts_with(data, size, pos, "</"))
+            {
+                std::size_t name = pos + 2;
+                pos = skip_past(data, size, name, ">");
+                // End tags of the elements containing the svg element are skipped
+                if (depth != 0 && --depth == 0)
+                {
+                    if (pos == npos || !is_svg_name(data, size, name))
+                    {
+                        return false;
+                    }
+                    end = pos;
+                    return true;
+                }
+            }
+            else
+            {
+                bool self_closing = false;
+                bool is_svg = depth == 0 && is_svg_name(data, size, pos + 1);
+                std::size_t tag_end = skip_tag(data, size, pos + 1, self_closing);
+                if (tag_end == npos)
+                {
+                    return false;
+                }
+
+                if (is_svg)
+                {
+                    begin = pos;
+                    if (self_closing)
+                    {
+                        end = tag_end;
+                        return true;
+                    }
+                    depth = 1;
+                }
+                else if (depth != 0 && !self_closing)
+                {
+                    ++depth;
+                }
+                pos = tag_end;
+            }
+
+            if (pos == npos)
+            {
+                return false;
+            }
+        }
+        return false;
+    }
+}
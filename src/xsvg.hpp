@@ -0,0 +1,30 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_SVG_HPP
+#define XPYT_SVG_HPP
+
+#include <cstddef>
+
+namespace xpyt
+{
+    /**
+     * Finds the first element named svg of an XML document in a single pass,
+     * without building a DOM. On success, [begin, end) is the byte range of
+     * the element, from the start of its start tag to the end of its end tag.
+     *
+     * Returns false when no svg element is found, when the document is not
+     * well-formed around it, or when it declares a DTD internal subset (the
+     * entities it defines would not be expanded in the extracted range).
+     */
+    bool find_svg_element(const char* data, std::size_t size, std::size_t& begin, std::size_t& end);
+}
+
+#endif
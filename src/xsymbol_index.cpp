@@ -0,0 +1,549 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+#include "xhandles.hpp"
+#include "xinternal_utils.hpp"
+#include "xsymbol_index.hpp"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    namespace
+    {
+        // Bounds the time spent indexing namespaces holding many objects,
+        // or objects with many attributes
+        constexpr std::size_t max_owner_count = 1000;
+        constexpr std::size_t max_attribute_count = 2000;
+
+        char to_lower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        char to_upper(char c)
+        {
+            return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+        }
+
+        const char* symbol_type(PyObject* obj)
+        {
+            if (PyType_Check(obj))
+            {
+                return "class";
+            }
+            if (PyModule_Check(obj))
+            {
+                return "module";
+            }
+            if (PyObject_TypeCheck(obj, &PyProperty_Type))
+            {
+                return "property";
+            }
+            if (PyCallable_Check(obj)
+                || PyObject_TypeCheck(obj, &PyClassMethod_Type)
+                || PyObject_TypeCheck(obj, &PyStaticMethod_Type))
+            {
+                return "function";
+            }
+            return "instance";
+        }
+
+        // Looks the name up in the dicts without invoking the descriptors,
+        // like inspect.getattr_static. Returns a null object if not found.
+        py::object lookup_static(const std::vector<py::object>& dicts, const py::handle& name)
+        {
+            for (const py::object& dict : dicts)
+            {
+                PyObject* value = PyObject_GetItem(dict.ptr(), name.ptr());
+                if (value != nullptr)
+                {
+                    return py::reinterpret_steal<py::object>(value);
+                }
+                PyErr_Clear();
+            }
+            return py::object();
+        }
+
+        // Returns false for the names that are not strings or cannot be
+        // encoded
+        bool to_utf8(const py::handle& name, std::string& res)
+        {
+            Py_ssize_t size = 0;
+            const char* data = PyUnicode_Check(name.ptr()) ? PyUnicode_AsUTF8AndSize(name.ptr(), &size) : nullptr;
+            if (data == nullptr)
+            {
+                PyErr_Clear();
+                return false;
+            }
+            res.assign(data, static_cast<std::size_t>(size));
+            return true;
+        }
+
+        // The attributes of a class are found in its MRO, the ones of an
+        // instance in its dict and then in the MRO of its type
+        std::vector<py::object> attribute_dicts(const py::handle& owner)
+        {
+            std::vector<py::object> dicts;
+            py::object mro;
+            if (PyType_Check(owner.ptr()))
+            {
+                mro = owner.attr("__mro__");
+            }
+            else
+            {
+                PyObject* dict = PyObject_GenericGetDict(owner.ptr(), nullptr);
+                if (dict != nullptr)
+                {
+                    dicts.push_back(py::reinterpret_steal<py::object>(dict));
+                }
+                else
+                {
+                    PyErr_Clear();
+                }
+                mro = py::type::of(owner).attr("__mro__");
+            }
+            for (py::handle base : mro)
+            {
+                dicts.push_back(base.attr("__dict__"));
+            }
+            return dicts;
+        }
+
+        // Whether dir() lists the attributes found in the dicts only, so
+        // that it cannot change while their sizes do not
+        bool has_default_dir(const py::handle& owner)
+        {
+            for (py::handle base : py::type::of(owner).attr("__mro__"))
+            {
+                py::object dict = base.attr("__dict__");
+                if (PyMapping_HasKeyString(dict.ptr(), "__dir__"))
+                {
+                    return base.ptr() == reinterpret_cast<PyObject*>(&PyBaseObject_Type)
+                        || base.ptr() == reinterpret_cast<PyObject*>(&PyType_Type)
+                        || base.ptr() == reinterpret_cast<PyObject*>(&PyModule_Type);
+                }
+            }
+            return false;
+        }
+
+        bool starts_with_icase(const std::string& name, const std::string& prefix)
+        {
+            if (name.size() < prefix.size())
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < prefix.size(); ++i)
+            {
+                if (to_lower(name[i]) != to_lower(prefix[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Returns true if a name of the code, other than the one starting
+        // at start, matches the token without being indexed: it may be a
+        // parameter or a variable that only the completer knows about.
+        // Attributes are not names, and names in strings are counted too.
+        bool has_unknown_name(const std::string& code,
+                              std::size_t start,
+                              const std::string& token,
+                              const xsymbol_trie& names)
+        {
+            std::size_t pos = 0;
+            while (pos < code.size())
+            {
+                if (!is_identifier_char(code[pos]))
+                {
+                    ++pos;
+                    continue;
+                }
+
+                std::size_t first = pos;
+                while (pos < code.size() && is_identifier_char(code[pos]))
+                {
+                    ++pos;
+                }
+                if (first == start
+                    || (first > 0 && code[first - 1] == '.')
+                    || (code[first] >= '0' && code[first] <= '9'))
+                {
+                    continue;
+                }
+
+                std::string name = code.substr(first, pos - first);
+                if (starts_with_icase(name, token) && !names.contains(name))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::size_t code_point_count(const std::string& text)
+        {
+            std::size_t count = 0;
+            for (char c : text)
+            {
+                if ((static_cast<unsigned char>(c) & 0xC0) != 0x80)
+                {
+                    ++count;
+                }
+            }
+            return count;
+        }
+    }
+
+    /*******************************
+     * xsymbol_trie implementation *
+     *******************************/
+
+    void xsymbol_trie::insert(const std::string& name, const char* type)
+    {
+        xnode* node = &m_root;
+        for (char c : name)
+        {
+            std::unique_ptr<xnode>& child = node->m_children[static_cast<unsigned char>(c)];
+            if (!child)
+            {
+                child.reset(new xnode());
+            }
+            node = child.get();
+        }
+        node->p_type = type;
+    }
+
+    bool xsymbol_trie::contains(const std::string& name) const
+    {
+        const xnode* node = &m_root;
+        for (char c : name)
+        {
+            auto it = node->m_children.find(static_cast<unsigned char>(c));
+            if (it == node->m_children.end())
+            {
+                return false;
+            }
+            node = it->second.get();
+        }
+        return node->p_type != nullptr;
+    }
+
+    std::vector<xsymbol> xsymbol_trie::find(const std::string& prefix) const
+    {
+        std::vector<xsymbol> res;
+        std::string name;
+        find_impl(m_root, prefix, name, res);
+        return res;
+    }
+
+    void xsymbol_trie::find_impl(const xnode& node,
+                                 const std::string& prefix,
+                                 std::string& name,
+                                 std::vector<xsymbol>& res) const
+    {
+        if (name.size() == prefix.size())
+        {
+            collect(node, name, res);
+            return;
+        }
+
+        // The upper case is visited first to keep the lexicographic order
+        char c = prefix[name.size()];
+        char cases[2] = { to_upper(c), to_lower(c) };
+        for (std::size_t i = 0; i < 2; ++i)
+        {
+            if (i == 1 && cases[1] == cases[0])
+            {
+                break;
+            }
+            auto it = node.m_children.find(static_cast<unsigned char>(cases[i]));
+            if (it != node.m_children.end())
+            {
+                name.push_back(cases[i]);
+                find_impl(*(it->second), prefix, name, res);
+                name.pop_back();
+            }
+        }
+    }
+
+    void xsymbol_trie::collect(const xnode& node, std::string& name, std::vector<xsymbol>& res) const
+    {
+        if (node.p_type != nullptr)
+        {
+            res.push_back({ name, node.p_type });
+        }
+        for (const auto& child : node.m_children)
+        {
+            name.push_back(static_cast<char>(child.first));
+            collect(*(child.second), name, res);
+            name.pop_back();
+        }
+    }
+
+    /********************************
+     * xsymbol_index implementation *
+     ********************************/
+
+    void xsymbol_index::update(const py::dict& user_ns)
+    {
+        auto snapshot = std::make_shared<xsnapshot>();
+        auto& handles = get_handles();
+
+        if (m_keywords.empty())
+        {
+            for (py::handle keyword : handles.keyword().attr(handles.kwlist))
+            {
+                m_keywords.push_back(keyword.cast<std::string>());
+            }
+        }
+        for (const std::string& keyword : m_keywords)
+        {
+            snapshot->m_names.insert(keyword, "keyword");
+        }
+
+        std::string name;
+        py::dict builtins = py::reinterpret_borrow<py::dict>(PyModule_GetDict(handles.builtins().ptr()));
+        for (auto item : builtins)
+        {
+            if (to_utf8(item.first, name))
+            {
+                snapshot->m_names.insert(name, symbol_type(item.second.ptr()));
+            }
+        }
+
+        std::unordered_map<std::string, xowner> owners;
+        std::size_t owner_count = 0;
+        for (auto item : user_ns)
+        {
+            if (!to_utf8(item.first, name))
+            {
+                continue;
+            }
+
+            snapshot->m_names.insert(name, symbol_type(item.second.ptr()));
+            if (!name.empty() && name[0] != '_' && owner_count < max_owner_count)
+            {
+                ++owner_count;
+                auto previous = m_owners.find(name);
+                xowner owner = index_owner(item.second, previous != m_owners.end() ? &(previous->second) : nullptr);
+                snapshot->m_attributes[name] = owner.m_attributes;
+                owners[name] = std::move(owner);
+            }
+        }
+        m_owners.swap(owners);
+
+        // The previous snapshot is released out of the lock
+        snapshot_ptr published = std::move(snapshot);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_snapshot.swap(published);
+        }
+    }
+
+    bool xsymbol_index::complete(const std::string& code, int cursor_pos, nl::json& reply) const
+    {
+        snapshot_ptr snapshot;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            snapshot = m_snapshot;
+        }
+
+        std::size_t end = utf8_offset(code, cursor_pos);
+        if (!snapshot || end == std::string::npos)
+        {
+            return false;
+        }
+
+        std::size_t start = end;
+        while (start > 0 && is_identifier_char(code[start - 1]))
+        {
+            --start;
+        }
+        std::string token = code.substr(start, end - start);
+        if (!token.empty() && token[0] >= '0' && token[0] <= '9')
+        {
+            return false;
+        }
+
+        // Strings, comments, magics and imports are left to the completer
+        std::size_t line_start = start == 0 ? std::string::npos : code.rfind('\n', start - 1);
+        line_start = line_start == std::string::npos ? 0 : line_start + 1;
+        std::string line = code.substr(line_start, start - line_start);
+        if (line.find_first_of("'\"#%!?\\") != std::string::npos || line.find("import") != std::string::npos)
+        {
+            return false;
+        }
+
+        const xsymbol_trie* symbols = &(snapshot->m_names);
+        if (start > 0 && code[start - 1] == '.')
+        {
+            // Only the attributes of a name are indexed, and not the
+            // private ones
+            std::size_t owner_end = start - 1;
+            std::size_t owner_start = owner_end;
+            while (owner_start > 0 && is_identifier_char(code[owner_start - 1]))
+            {
+                --owner_start;
+            }
+            if (owner_start == owner_end
+                || (owner_start > 0 && code[owner_start - 1] == '.')
+                || (code[owner_start] >= '0' && code[owner_start] <= '9')
+                || (!token.empty() && token[0] == '_'))
+            {
+                return false;
+            }
+
+            auto it = snapshot->m_attributes.find(code.substr(owner_start, owner_end - owner_start));
+            if (it == snapshot->m_attributes.end())
+            {
+                return false;
+            }
+            symbols = it->second.get();
+        }
+        else if (token.empty() || has_unknown_name(code, start, token, snapshot->m_names))
+        {
+            return false;
+        }
+
+        std::vector<xsymbol> found = symbols->find(token);
+        if (found.empty())
+        {
+            return false;
+        }
+
+        int cursor_start = cursor_pos - static_cast<int>(code_point_count(token));
+        nl::json matches = nl::json::array();
+        nl::json types = nl::json::array();
+        for (const xsymbol& symbol : found)
+        {
+            matches.push_back(symbol.m_name);
+            types.push_back({
+                { "start", cursor_start },
+                { "end", cursor_pos },
+                { "text", symbol.m_name },
+                { "type", symbol.p_type }
+            });
+        }
+
+        reply["matches"] = std::move(matches);
+        reply["cursor_start"] = cursor_start;
+        reply["cursor_end"] = cursor_pos;
+        reply["metadata"] = { { "_jupyter_types_experimental", std::move(types) } };
+        reply["status"] = "ok";
+        return true;
+    }
+
+    auto xsymbol_index::index_owner(const py::handle& owner, const xowner* previous) -> xowner
+    {
+        xowner res;
+        res.m_reference = py::reinterpret_steal<py::object>(PyWeakref_NewRef(owner.ptr(), nullptr));
+        res.m_weak = static_cast<bool>(res.m_reference);
+        if (!res.m_weak)
+        {
+            PyErr_Clear();
+            res.m_reference = py::reinterpret_borrow<py::object>(owner);
+        }
+        res.m_type = py::reinterpret_borrow<py::object>(reinterpret_cast<PyObject*>(Py_TYPE(owner.ptr())));
+
+        auto attributes = std::make_shared<xsymbol_trie>();
+        try
+        {
+            std::vector<py::object> dicts = attribute_dicts(owner);
+            for (const py::object& dict : dicts)
+            {
+                Py_ssize_t size = PyObject_Size(dict.ptr());
+                if (size < 0)
+                {
+                    throw py::error_already_set();
+                }
+                res.m_sizes.push_back(size);
+            }
+
+            // A dead weak reference refers to None
+            if (previous != nullptr
+                && (previous->m_weak ? PyWeakref_GetObject(previous->m_reference.ptr()) : previous->m_reference.ptr()) == owner.ptr()
+                && previous->m_type.is(res.m_type)
+                && previous->m_sizes == res.m_sizes
+                && has_default_dir(owner))
+            {
+                res.m_attributes = previous->m_attributes;
+                return res;
+            }
+
+            index_attributes(owner, dicts, *attributes);
+        }
+        catch (py::error_already_set&)
+        {
+            // The objects whose attributes cannot be listed are not
+            // indexed, and indexed again by the next update
+            res.m_sizes.clear();
+        }
+
+        res.m_attributes = std::move(attributes);
+        return res;
+    }
+
+    void xsymbol_index::index_attributes(const py::handle& owner,
+                                         const std::vector<py::object>& dicts,
+                                         xsymbol_trie& attributes)
+    {
+        try
+        {
+            py::object names = py::reinterpret_steal<py::object>(PyObject_Dir(owner.ptr()));
+            if (!names)
+            {
+                throw py::error_already_set();
+            }
+
+            std::size_t count = 0;
+            std::string attribute;
+            for (py::handle name : names)
+            {
+                if (!to_utf8(name, attribute) || attribute.empty() || attribute[0] == '_')
+                {
+                    continue;
+                }
+                if (++count > max_attribute_count)
+                {
+                    break;
+                }
+
+                py::object value = lookup_static(dicts, name);
+                attributes.insert(attribute, value ? symbol_type(value.ptr()) : "instance");
+            }
+        }
+        catch (py::error_already_set&)
+        {
+            // The objects whose __dir__ fails are indexed partially
+        }
+    }
+
+    // The index holds Python objects, it is not destroyed after the
+    // interpreter is finalized
+    xsymbol_index& get_symbol_index()
+    {
+        static xsymbol_index* index = new xsymbol_index();
+        return *index;
+    }
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPYT_SYMBOL_INDEX_HPP
+#define XPYT_SYMBOL_INDEX_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+namespace nl = nlohmann;
+
+namespace xpyt
+{
+    struct xsymbol
+    {
+        std::string m_name;
+        // One of the jedi completion types: "class", "function",
+        // "instance", "keyword", "module" or "property"
+        const char* p_type;
+    };
+
+    /****************************
+     * xsymbol_trie declaration *
+     ****************************/
+
+    class xsymbol_trie
+    {
+    public:
+
+        void insert(const std::string& name, const char* type);
+
+        // Whether the name was inserted, compared case-sensitively
+        bool contains(const std::string& name) const;
+
+        // Symbols starting with the prefix, compared case-insensitively
+        // like jedi does, in lexicographic order
+        std::vector<xsymbol> find(const std::string& prefix) const;
+
+    private:
+
+        struct xnode
+        {
+            std::map<unsigned char, std::unique_ptr<xnode>> m_children;
+            // Not null when a name ends at this node
+            const char* p_type = nullptr;
+        };
+
+        void find_impl(const xnode& node,
+                       const std::string& prefix,
+                       std::string& name,
+                       std::vector<xsymbol>& res) const;
+
+        void collect(const xnode& node, std::string& name, std::vector<xsymbol>& res) const;
+
+        xnode m_root;
+    };
+
+    /*****************************
+     * xsymbol_index declaration *
+     *****************************/
+
+    /**
+     * Snapshot of the names of the user namespace, of the builtins and
+     * keywords, and of the public attributes of the names, taken after each
+     * execution. The attributes are looked up statically, so that indexing
+     * does not run properties nor __getattr__. They are indexed again only
+     * for the names bound to another object since the previous snapshot,
+     * or whose attributes were added or removed.
+     *
+     * The completion of a name, or of an attribute of a name, is answered
+     * from the last snapshot without the GIL. The other completions, the
+     * ones the snapshot has no match for, and the names that may refer to
+     * a name defined in the code being completed (a parameter, a local
+     * variable) are left to the completer.
+     */
+    class xsymbol_index
+    {
+    public:
+
+        // Must be called with the GIL held
+        void update(const py::dict& user_ns);
+
+        // Fills the reply and returns true if the index can answer
+        bool complete(const std::string& code, int cursor_pos, nl::json& reply) const;
+
+    private:
+
+        using trie_ptr = std::shared_ptr<const xsymbol_trie>;
+
+        struct xsnapshot
+        {
+            xsymbol_trie m_names;
+            std::unordered_map<std::string, trie_ptr> m_attributes;
+        };
+
+        using snapshot_ptr = std::shared_ptr<const xsnapshot>;
+
+        // Attributes of a name of the user namespace. The object is held
+        // through a weak reference, or a strong one when it does not
+        // support them, so that another object allocated at its address
+        // is not mistaken for it.
+        struct xowner
+        {
+            py::object m_reference;
+            bool m_weak = false;
+            py::object m_type;
+            // Sizes of the dicts the attributes are looked up in
+            std::vector<Py_ssize_t> m_sizes;
+            trie_ptr m_attributes;
+        };
+
+        static xowner index_owner(const py::handle& owner, const xowner* previous);
+        static void index_attributes(const py::handle& owner,
+                                     const std::vector<py::object>& dicts,
+                                     xsymbol_trie& attributes);
+
+        snapshot_ptr m_snapshot;
+        mutable std::mutex m_mutex;
+
+        // Only accessed by update(), with the GIL held. The owners hold
+        // Python objects, the index must be destroyed with the GIL held.
+        std::vector<std::string> m_keywords;
+        std::unordered_map<std::string, xowner> m_owners;
+    };
+
+    xsymbol_index& get_symbol_index();
+}
+
+#endif
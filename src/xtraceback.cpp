@@ -18,6 +18,7 @@
 
 #include "pybind11/pybind11.h"
 
+#include "xhandles.hpp"
 #include "xinternal_utils.hpp"
 
 namespace py = pybind11;
@@ -95,7 +96,7 @@ namespace xpyt
 
             if (py_tb.ptr() != nullptr && !py_tb.is_none())
             {
-                for (py::handle py_frame : py::module::import("traceback").attr("extract_tb")(py_tb))
+                for (py::handle py_frame : get_handles().traceback().attr(get_handles().extract_tb)(py_tb))
                 {
                     std::string filename;
                     std::string lineno;
@@ -61,6 +61,23 @@ namespace xpyt
 
     void exec(const py::object& code, const py::object& scope)
     {
+        if (PyCode_Check(code.ptr()) && PyDict_Check(scope.ptr()))
+        {
+            // Code objects are run directly, like the exec builtin does
+            if (PyDict_GetItemString(scope.ptr(), "__builtins__") == nullptr &&
+                PyDict_SetItemString(scope.ptr(), "__builtins__", PyEval_GetBuiltins()) != 0)
+            {
+                throw py::error_already_set();
+            }
+            PyObject* res = PyEval_EvalCode(code.ptr(), scope.ptr(), scope.ptr());
+            if (res == nullptr)
+            {
+                throw py::error_already_set();
+            }
+            Py_DECREF(res);
+            return;
+        }
+
         py::exec("exec(_code_, _scope_, _scope_)", py::globals(), py::dict(py::arg("_code_") = code, py::arg("_scope_") = scope));
     }
 
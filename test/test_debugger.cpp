@@ -306,6 +306,16 @@ nl::json make_debug_info_request(int seq)
     return req;
 }
 
+nl::json make_metrics_request(int seq)
+{
+    nl::json req = {
+        {"type", "request"},
+        {"seq", seq},
+        {"command", "metrics"}
+    };
+    return req;
+}
+
 nl::json make_inspect_variables_request(int seq)
 {
     nl::json req = {
@@ -396,6 +406,7 @@ public:
     bool test_step_in();
     bool test_stack_trace();
     bool test_debug_info();
+    bool test_metrics();
     bool test_inspect_variables();
     bool test_rich_inspect_variables();
     bool test_variables();
@@ -728,6 +739,23 @@ bool debugger_client::test_debug_info()
     return res && res2 && stopped_list2[0] == 1;
 }
 
+bool debugger_client::test_metrics()
+{
+    m_client.send_on_shell("execute_request", make_execute_request("print('metrics')"));
+    nl::json rep1 = m_client.receive_on_shell();
+    bool res = rep1["content"]["status"] == "ok";
+
+    m_client.send_on_control("debug_request", make_metrics_request(1));
+    nl::json rep2 = m_client.receive_on_control();
+
+    nl::json body = rep2["content"]["body"];
+    res = res && rep2["content"]["success"] == true;
+    res = res && body["metrics"]["requests"]["execute"]["count"].get<int>() >= 1;
+    res = res && body["metrics"]["publications"]["stream"]["count"].get<int>() >= 1;
+    res = res && body["prometheus"].get<std::string>().find("xeus_python_requests_total{request=\"execute\"}") != std::string::npos;
+    return res;
+}
+
 bool debugger_client::test_inspect_variables()
 {
     attach();
@@ -1338,6 +1366,21 @@ TEST_SUITE("debugger")
         }
     }
 
+    TEST_CASE("metrics")
+    {
+        start_kernel();
+        timer t;
+        zmq::context_t context;
+        {
+            debugger_client deb(context, KERNEL_JSON, "debugger_metrics.log");
+            bool res = deb.test_metrics();
+            deb.shutdown();
+            std::this_thread::sleep_for(2s);
+            CHECK(res);
+            t.notify_done();
+        }
+    }
+
     TEST_CASE("inspect_variables")
     {
         start_kernel();
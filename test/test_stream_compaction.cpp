@@ -0,0 +1,89 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "doctest/doctest.h"
+
+#include <string>
+
+#include "xstream_compaction.hpp"
+
+std::string fold(const std::string& line)
+{
+    return xpyt::fold_carriage_returns(line, 0, line.size());
+}
+
+TEST_SUITE("stream_compaction")
+{
+    TEST_CASE("fold_carriage_returns")
+    {
+        CHECK(fold("abc") == "abc");
+        CHECK(fold("abc\rxy") == "xyc");
+        CHECK(fold("10%\r20%\r100%") == "100%");
+        CHECK(fold("abc\r") == "abc");
+        CHECK(fold("\rabc") == "abc");
+
+        // The characters are overwritten, not the bytes
+        CHECK(fold("\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac\rab") == "ab\xe2\x82\xac");
+        CHECK(fold("abc\r\xc3\xa9") == "\xc3\xa9" "bc");
+
+        // Only the range given is folded
+        std::string text = "x\n12\r3\ny";
+        CHECK(xpyt::fold_carriage_returns(text, 2, 6) == "32");
+    }
+
+    TEST_CASE("first_carriage_return")
+    {
+        // The beginning of the first line may have been sent in a previous
+        // message, which the first carriage return must still overwrite
+        CHECK(xpyt::compact_stream_output("10%\r20%\r30%") == "10%\r30%");
+        CHECK(xpyt::compact_stream_output("\r20%\r30%") == "\r30%");
+        CHECK(xpyt::compact_stream_output("abc\rx") == "abc\rx");
+
+        // The other lines are folded entirely
+        CHECK(xpyt::compact_stream_output("x\n10%\r20%\r30%") == "x\n30%");
+        CHECK(xpyt::compact_stream_output("x\ny\r1\r2\nz") == "x\n2\nz");
+    }
+
+    TEST_CASE("carriage_return_newline")
+    {
+        CHECK(xpyt::compact_stream_output("a\r\nb") == "a\nb");
+        CHECK(xpyt::compact_stream_output("a\r\r\nb\r\n") == "a\nb\n");
+        CHECK(xpyt::compact_stream_output("x\n10%\r100%\r\n") == "x\n100%\n");
+    }
+
+    TEST_CASE("trailing_carriage_return")
+    {
+        // The carriage return ending the output overwrites the next message
+        CHECK(xpyt::compact_stream_output("done\r") == "done\r");
+        CHECK(xpyt::compact_stream_output("\r") == "\r");
+        CHECK(xpyt::compact_stream_output("x\n10%\r20%\r") == "x\n20%\r");
+    }
+
+    TEST_CASE("utf8")
+    {
+        CHECK(xpyt::compact_stream_output("x\n\xc3\xa9t\xc3\xa9\rab") == "x\nab\xc3\xa9");
+        CHECK(xpyt::compact_stream_output("x\n\xe2\x96\x88\xe2\x96\x88\r\xe2\x96\x91") == "x\n\xe2\x96\x91\xe2\x96\x88");
+    }
+
+    TEST_CASE("erase_sequences")
+    {
+        CHECK(xpyt::compact_stream_output("\x1b[K\x1b[K\x1b[Kz") == "\x1b[Kz");
+        CHECK(xpyt::compact_stream_output("a\x1b[2K\x1b[2K\x1b[0K\x1b[0Kb") == "a\x1b[2K\x1b[0Kb");
+        CHECK(xpyt::compact_stream_output("\x1b[K1\x1b[K2") == "\x1b[K1\x1b[K2");
+        CHECK(xpyt::compact_stream_output("x\n\x1b[K\x1b[K1\r\x1b[K\x1b[K2") == "x\n\x1b[K2");
+    }
+
+    TEST_CASE("unchanged")
+    {
+        CHECK(xpyt::compact_stream_output("") == "");
+        CHECK(xpyt::compact_stream_output("line\n") == "line\n");
+        CHECK(xpyt::compact_stream_output("a\nb\n\nc") == "a\nb\n\nc");
+    }
+}
@@ -0,0 +1,139 @@
+/***************************************************************************
+* Copyright (c) 2018, Martin Renou, Johan Mabille, Sylvain Corlay, and     *
+* Wolf Vollprecht                                                          *
+* Copyright (c) 2018, QuantStack                                           *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "pybind11/embed.h"
+#include "pybind11/pybind11.h"
+
+#include "xsymbol_index.hpp"
+
+namespace nl = nlohmann;
+namespace py = pybind11;
+
+std::vector<std::string> names_of(const std::vector<xpyt::xsymbol>& symbols)
+{
+    std::vector<std::string> res;
+    for (const auto& symbol : symbols)
+    {
+        res.push_back(symbol.m_name);
+    }
+    return res;
+}
+
+TEST_SUITE("symbol_index")
+{
+    TEST_CASE("trie")
+    {
+        xpyt::xsymbol_trie trie;
+        trie.insert("list", "class");
+        trie.insert("length", "instance");
+        trie.insert("len", "function");
+        trie.insert("Lambda", "class");
+
+        CHECK(names_of(trie.find("l")) == std::vector<std::string>({ "Lambda", "len", "length", "list" }));
+        CHECK(names_of(trie.find("LE")) == std::vector<std::string>({ "len", "length" }));
+        CHECK(names_of(trie.find("")).size() == 4);
+        CHECK(trie.find("lex").empty());
+        CHECK(std::string(trie.find("len")[0].p_type) == "function");
+
+        CHECK(trie.contains("len"));
+        CHECK_FALSE(trie.contains("le"));
+        CHECK_FALSE(trie.contains("LEN"));
+    }
+
+    // The interpreter is started once: the handles of the kernel are not
+    // released when it is finalized.
+    TEST_CASE("complete")
+    {
+        py::scoped_interpreter interpreter;
+        py::dict user_ns;
+        py::exec("import os\n"
+                 "class Sample:\n"
+                 "    count = 0\n"
+                 "    @property\n"
+                 "    def value(self):\n"
+                 "        raise RuntimeError()\n"
+                 "sample = Sample()\n"
+                 "sample_size = 3\n", user_ns);
+
+        xpyt::xsymbol_index index;
+        nl::json reply;
+        auto complete = [&index, &reply](const std::string& code)
+        {
+            return index.complete(code, static_cast<int>(code.size()), reply);
+        };
+        CHECK_FALSE(complete("sam"));
+
+        index.update(user_ns);
+        REQUIRE(complete("sam"));
+        CHECK(reply["matches"] == nl::json::array({ "Sample", "sample", "sample_size" }));
+        CHECK(reply["cursor_start"] == 0);
+        CHECK(reply["cursor_end"] == 3);
+        CHECK(reply["metadata"]["_jupyter_types_experimental"][0]["type"] == "class");
+
+        REQUIRE(complete("x = sample."));
+        CHECK(reply["matches"] == nl::json::array({ "count", "value" }));
+        CHECK(reply["cursor_start"] == 11);
+        CHECK(reply["metadata"]["_jupyter_types_experimental"][1]["type"] == "property");
+
+        REQUIRE(complete("pri"));
+        CHECK(reply["matches"] == nl::json::array({ "print" }));
+        REQUIRE(complete("whil"));
+        CHECK(reply["matches"] == nl::json::array({ "while" }));
+
+        // Names the code may define, and the private attributes, strings,
+        // imports and magics are left to the completer
+        CHECK_FALSE(complete("def f(length):\n    return le"));
+        CHECK_FALSE(complete("sample_other = 1\nsam"));
+        CHECK(complete("print(sample_size)\nsam"));
+        CHECK_FALSE(complete("sample._"));
+        CHECK_FALSE(complete("'sam"));
+        CHECK_FALSE(complete("from os import pa"));
+        CHECK_FALSE(complete("%ti"));
+        CHECK_FALSE(complete("missing."));
+
+        // The attributes added since the previous update are indexed
+        py::exec("Sample.total = 1\nsample.extra = 2\n", user_ns);
+        index.update(user_ns);
+        REQUIRE(complete("sample."));
+        CHECK(reply["matches"] == nl::json::array({ "count", "extra", "total", "value" }));
+        REQUIRE(complete("Sample.t"));
+        CHECK(reply["matches"] == nl::json::array({ "total" }));
+
+        // An object rebound to another one with as many attributes, which
+        // may be allocated at the same address, is indexed again
+        py::exec("import types\n"
+                 "weak_sample = Sample()\n"
+                 "weak_sample.first = 1\n"
+                 "space_sample = types.SimpleNamespace(first=1)\n", user_ns);
+        index.update(user_ns);
+        REQUIRE(complete("weak_sample.f"));
+        CHECK(reply["matches"] == nl::json::array({ "first" }));
+        REQUIRE(complete("space_sample."));
+        CHECK(reply["matches"] == nl::json::array({ "first" }));
+        py::exec("weak_sample = None\n"
+                 "weak_sample = Sample()\n"
+                 "weak_sample.second = 2\n"
+                 "space_sample = None\n"
+                 "space_sample = types.SimpleNamespace(second=2)\n", user_ns);
+        index.update(user_ns);
+        CHECK_FALSE(complete("weak_sample.f"));
+        REQUIRE(complete("weak_sample.s"));
+        CHECK(reply["matches"] == nl::json::array({ "second" }));
+        REQUIRE(complete("space_sample."));
+        CHECK(reply["matches"] == nl::json::array({ "second" }));
+    }
+}
@@ -8,6 +8,9 @@
 # The full license is in the file LICENSE, distributed with this software.  #
 #############################################################################
 
+import os
+import shutil
+import tempfile
 import unittest
 import jupyter_kernel_test
 
@@ -49,6 +52,228 @@ class XeusPythonTests(jupyter_kernel_test.KernelTests):
         reply, output_msgs = self.execute_helper(code='a = []; a.push_back(3)')
         self.assertEqual(output_msgs[0]['msg_type'], 'error')
 
+    def test_xeus_python_display_deduplication(self):
+        code = (
+            "from IPython.display import display, update_display\n"
+            "display('a', display_id='dedup')\n"
+            "update_display('a', display_id='dedup')\n"
+            "update_display('b', display_id='dedup')\n"
+            "update_display('b', display_id='dedup')"
+        )
+        reply, output_msgs = self.execute_helper(code=code)
+        msg_types = [msg['msg_type'] for msg in output_msgs]
+        self.assertEqual(msg_types, ['display_data', 'update_display_data'])
+        self.assertEqual(output_msgs[1]['content']['data']['text/plain'], "'b'")
+
+    def test_xeus_python_cell_profile(self):
+        self.execute_helper(code="get_ipython().kernel.profile_cells = True")
+        reply, output_msgs = self.execute_helper(code="x = sum(range(1000))\nx")
+        self.execute_helper(code="get_ipython().kernel.profile_cells = False")
+        profile = reply['content']['profile']
+        for phase in ['transform', 'compile', 'execute', 'format', 'publish', 'payload', 'total']:
+            self.assertGreaterEqual(profile[phase], 0)
+        self.assertGreater(profile['compile'], 0)
+
+        # The methods of the shell are restored once the profile is disabled
+        reply, output_msgs = self.execute_helper(code=(
+            "shell = get_ipython()\n"
+            "assert 'transform_cell' not in vars(shell)\n"
+            "assert 'extra_flags' not in vars(shell.compile)\n"
+            "assert 'format' not in vars(shell.display_formatter)\n"
+            "assert type(shell.compile).__module__ == 'IPython.core.compilerop'"
+        ))
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertNotIn('profile', reply['content'])
+
+    def complete_helper(self, code):
+        self.kc.complete(code)
+        reply = self.get_non_kernel_info_reply()
+        return set(reply['content']['matches'])
+
+    def test_xeus_python_completion_cache(self):
+        self.execute_helper(code="cache_sample_one = 1\ncache_sample_two = 2")
+        self.assertEqual(self.complete_helper("cache_sample_"), {'cache_sample_one', 'cache_sample_two'})
+        self.assertEqual(self.complete_helper("cache_sample_o"), {'cache_sample_one'})
+        self.execute_helper(code="cache_sample_other = 3")
+        self.assertEqual(self.complete_helper("cache_sample_o"), {'cache_sample_one', 'cache_sample_other'})
+
+    def test_xeus_python_completion_cache_case(self):
+        # IPython completes the names case-sensitively, the cache must too
+        self.execute_helper(code="case_sample_low = 1\ncase_sample_Up = 2")
+        self.assertEqual(self.complete_helper("case_sample_"), {'case_sample_low', 'case_sample_Up'})
+        self.assertEqual(self.complete_helper("case_sample_u"), set())
+        self.assertEqual(self.complete_helper("case_sample_"), {'case_sample_low', 'case_sample_Up'})
+        self.assertEqual(self.complete_helper("case_sample_U"), {'case_sample_Up'})
+
+    def test_xeus_python_completion_cache_private(self):
+        self.execute_helper(code="class CacheSample:\n    _hidden = 1\n    shown = 2\ncache_sample = CacheSample()")
+        self.complete_helper("cache_sample.")
+        matches = self.complete_helper("cache_sample._")
+        self.assertTrue(any(match.endswith('_hidden') for match in matches))
+
+    def test_xeus_python_comm_message(self):
+        self.execute_helper(code=(
+            "import comm\n"
+            "stored_messages = []\n"
+            "comm.get_comm_manager().register_target('message_sample', lambda comm, msg: stored_messages.append(msg))"
+        ))
+        msg = self.kc.session.msg('comm_open', {
+            'comm_id': 'message_sample_id',
+            'target_name': 'message_sample',
+            'data': {'value': 42}
+        })
+        self.kc.shell_channel.send(msg)
+        reply, output_msgs = self.execute_helper(code=(
+            "import copy, json, pickle\n"
+            "msg = stored_messages[0]\n"
+            "assert isinstance(msg, dict)\n"
+            "assert msg['content']['data'] == {'value': 42}\n"
+            "assert json.loads(json.dumps(msg))['content']['data'] == {'value': 42}\n"
+            "assert copy.deepcopy(msg) == msg\n"
+            "assert pickle.loads(pickle.dumps(msg)) == msg\n"
+            "assert list(msg) == ['header', 'parent_header', 'metadata', 'content', 'buffers']"
+        ))
+        self.assertEqual(reply['content']['status'], 'ok')
+
+    def test_xeus_python_comm_coalesce_updates(self):
+        reply, output_msgs = self.execute_helper(code=(
+            "import comm\n"
+            "c = comm.create_comm(target_name='coalesce_sample')\n"
+            "c.coalesce_updates = True\n"
+            "c.send({'method': 'update', 'state': {'a': 1, 'x': None, 'y': None}, 'buffer_paths': [['x'], ['y']]},\n"
+            "       buffers=[b'x1', b'y1'])\n"
+            "c.send({'method': 'update', 'state': {'x': None, 'b': 2}, 'buffer_paths': [['x']]}, buffers=[b'x2'])"
+        ))
+        self.assertEqual(reply['content']['status'], 'ok')
+        updates = [msg for msg in output_msgs if msg['msg_type'] == 'comm_msg']
+        self.assertEqual(len(updates), 1)
+
+        # The buffer of x sent first is dropped, the one of y is renumbered
+        data = updates[0]['content']['data']
+        self.assertEqual(data['state'], {'a': 1, 'x': None, 'y': None, 'b': 2})
+        self.assertEqual(data['buffer_paths'], [['y'], ['x']])
+        self.assertEqual([bytes(buffer) for buffer in updates[0]['buffers']], [b'y1', b'x2'])
+
+
+class XeusPythonStoreTests(unittest.TestCase):
+
+    store_key_missing = '0' * 64
+
+    @classmethod
+    def setUpClass(cls):
+        cls.store_dir = tempfile.mkdtemp()
+        cls.km, cls.kc = start_new_kernel(
+            kernel_name='xpython',
+            extra_arguments=['--display-store-threshold', '100', '--display-store-dir', cls.store_dir]
+        )
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.kc.stop_channels()
+        cls.km.shutdown_kernel()
+        shutil.rmtree(cls.store_dir)
+
+    def iopub_messages(self, msg_id, last_type):
+        messages = []
+        while not messages or messages[-1]['msg_type'] != last_type:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg['parent_header'].get('msg_id') == msg_id:
+                messages.append(msg)
+        return messages
+
+    def display_stored(self, code):
+        msg_id = self.kc.execute(code)
+        self.kc.get_shell_msg(timeout=10)
+        messages = self.iopub_messages(msg_id, 'status')
+        while messages[-1]['content']['execution_state'] != 'idle':
+            messages += self.iopub_messages(msg_id, 'status')
+        display = [msg for msg in messages if msg['msg_type'] == 'display_data'][0]
+        return display['content']['data']['application/vnd.xeus-python.store+json']['text/html']
+
+    def fetch(self, keys):
+        msg = self.kc.session.msg('comm_open', {
+            'comm_id': 'store_test_' + str(len(keys)),
+            'target_name': 'xeus-python.store',
+            'data': {'keys': keys}
+        })
+        self.kc.shell_channel.send(msg)
+        messages = self.iopub_messages(msg['header']['msg_id'], 'comm_close')
+        return [msg for msg in messages if msg['msg_type'] == 'comm_msg']
+
+    def test_xeus_python_store(self):
+        code = "from IPython.display import HTML, display\ndisplay(HTML('x' * 1000))"
+        reference = self.display_stored(code)
+        self.assertEqual(reference['size'], 1000)
+        key = reference['key']
+
+        replies = self.fetch([key, self.store_key_missing, '../secret'])
+        self.assertEqual([reply['content']['data'] for reply in replies], [
+            {'key': key, 'found': True},
+            {'key': self.store_key_missing, 'found': False},
+            {'key': '../secret', 'found': False}
+        ])
+        self.assertEqual(bytes(replies[0]['buffers'][0]), b'x' * 1000)
+
+        # A modified file is not sent, and is written again by the next display
+        with open(os.path.join(self.store_dir, key), 'w') as f:
+            f.write('modified')
+        self.assertEqual(self.fetch([key])[0]['content']['data']['found'], False)
+        self.display_stored(code)
+        replies = self.fetch([key])
+        self.assertEqual(bytes(replies[0]['buffers'][0]), b'x' * 1000)
+
+
+class XeusPythonOutputLimitTests(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.km, cls.kc = start_new_kernel(
+            kernel_name='xpython',
+            extra_arguments=['--stream-max-cell-bytes', '100', '--stream-max-cell-messages', '3']
+        )
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.kc.stop_channels()
+        cls.km.shutdown_kernel()
+
+    def execute_streams(self, code):
+        msg_id = self.kc.execute(code)
+        self.kc.get_shell_msg(timeout=10)
+        streams = {'stdout': '', 'stderr': ''}
+        while True:
+            msg = self.kc.get_iopub_msg(timeout=10)
+            if msg['parent_header'].get('msg_id') != msg_id:
+                continue
+            if msg['msg_type'] == 'stream':
+                streams[msg['content']['name']] += msg['content']['text']
+            elif msg['msg_type'] == 'status' and msg['content']['execution_state'] == 'idle':
+                return streams
+
+    def spilled(self, notice, size):
+        prefix = '%d more bytes were written to ' % size
+        self.assertIn('Output truncated', notice)
+        self.assertIn(prefix, notice)
+        path = notice[notice.index(prefix) + len(prefix):].strip()
+        if os.name != 'nt':
+            self.assertEqual(os.stat(os.path.dirname(path)).st_mode & 0o777, 0o700)
+        with open(path) as f:
+            return f.read()
+
+    def test_xeus_python_max_cell_bytes(self):
+        streams = self.execute_streams("print('x' * 300)")
+        self.assertEqual(streams['stdout'], 'x' * 100)
+        self.assertEqual(self.spilled(streams['stderr'], 201), 'x' * 200 + '\n')
+
+    def test_xeus_python_max_cell_messages(self):
+        streams = self.execute_streams("import sys\nfor i in range(5):\n    sys.stdout.write('%d\\n' % i)")
+        self.assertEqual(streams['stdout'], '0\n1\n2\n')
+        self.assertEqual(self.spilled(streams['stderr'], 4), '3\n4\n')
+
+    def test_xeus_python_within_limits(self):
+        streams = self.execute_streams("print('x')")
+        self.assertEqual(streams, {'stdout': 'x\n', 'stderr': ''})
+
 
 if __name__ == '__main__':
     unittest.main()
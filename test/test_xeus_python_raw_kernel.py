@@ -8,6 +8,7 @@
 # The full license is in the file LICENSE, distributed with this software.  #
 #############################################################################
 
+import base64
 import unittest
 import jupyter_kernel_test
 
@@ -74,6 +75,109 @@ class XeusPythonRawTests(jupyter_kernel_test.KernelTests):
             traceback[2]
         )
 
+    def test_xeus_python_repr_methods(self):
+        self.flush_channels()
+        code = (
+            "class A:\n"
+            "    def _repr_html_(self):\n"
+            "        return '<b>a</b>'\n"
+            "display(A())\n"
+            "A._repr_markdown_ = lambda self: '**a**'\n"
+            "a = A()\n"
+            "a._repr_latex_ = lambda: '$a$'\n"
+            "display(a)"
+        )
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(output_msgs[0]['msg_type'], 'display_data')
+        self.assertEqual(output_msgs[0]['content']['data']['text/html'], '<b>a</b>')
+        self.assertNotIn('text/markdown', output_msgs[0]['content']['data'])
+        self.assertEqual(output_msgs[1]['msg_type'], 'display_data')
+        self.assertEqual(output_msgs[1]['content']['data']['text/markdown'], '**a**')
+        self.assertEqual(output_msgs[1]['content']['data']['text/latex'], '$a$')
+
+    def test_xeus_python_bytes_repr(self):
+        self.flush_channels()
+        code = (
+            "class Image:\n"
+            "    def _repr_png_(self):\n"
+            "        return bytes(range(256)) * 3 + b'ab'\n"
+            "display(Image())"
+        )
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(output_msgs[0]['msg_type'], 'display_data')
+        self.assertEqual(
+            output_msgs[0]['content']['data']['image/png'],
+            base64.b64encode(bytes(range(256)) * 3 + b'ab').decode('ascii')
+        )
+
+    def test_xeus_python_file_display_object(self):
+        self.flush_channels()
+        code = (
+            "import json, os, tempfile\n"
+            "from IPython.core.display import JSON\n"
+            "path = os.path.join(tempfile.mkdtemp(), 'data.json')\n"
+            "with open(path, 'w') as f:\n"
+            "    json.dump({'a': 1}, f)\n"
+            "j = JSON(filename=path)\n"
+            "display(j)\n"
+            "with open(path, 'w') as f:\n"
+            "    json.dump({'a': 22}, f)\n"
+            "display(j)\n"
+            "os.remove(path)\n"
+            "display(j)"
+        )
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(output_msgs[0]['content']['data']['application/json'], {'a': 1})
+        self.assertEqual(output_msgs[1]['content']['data']['application/json'], {'a': 22})
+        # The data last read is kept once the file is removed
+        self.assertEqual(output_msgs[2]['content']['data']['application/json'], {'a': 22})
+
+    def test_xeus_python_svg_file(self):
+        self.flush_channels()
+        code = (
+            "import os, tempfile\n"
+            "from IPython.core.display import SVG\n"
+            "path = os.path.join(tempfile.mkdtemp(), 'plot.svg')\n"
+            "with open(path, 'w') as f:\n"
+            "    f.write('<?xml version=\"1.0\"?>\\n<!-- <svg> -->\\n'\n"
+            "            '<svg xmlns=\"http://www.w3.org/2000/svg\"><g><path d=\"M0 0\"/></g></svg>\\n')\n"
+            "display(SVG(filename=path))"
+        )
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(
+            output_msgs[0]['content']['data']['image/svg+xml'],
+            '<svg xmlns="http://www.w3.org/2000/svg"><g><path d="M0 0"/></g></svg>'
+        )
+
+    def test_xeus_python_rerun_cell(self):
+        self.flush_channels()
+        self.execute_helper(code="counter = 0")
+        for expected in ['1', '2']:
+            reply, output_msgs = self.execute_helper(code="counter += 1\ncounter")
+            self.assertEqual(reply['content']['status'], 'ok')
+            self.assertEqual(output_msgs[0]['msg_type'], 'execute_result')
+            self.assertEqual(output_msgs[0]['content']['data']['text/plain'], expected)
+
+    def test_xeus_python_progress_bar(self):
+        self.flush_channels()
+        code = (
+            "from IPython.core.display import ProgressBar\n"
+            "print(list(ProgressBar(iter('abc'))))\n"
+            "class Total:\n"
+            "    def __index__(self):\n"
+            "        return 3\n"
+            "print(ProgressBar(Total()).total)\n"
+            "for i in ProgressBar(6000, interval=3600):\n"
+            "    pass"
+        )
+        reply, output_msgs = self.execute_helper(code=code)
+        streams = [msg for msg in output_msgs if msg['msg_type'] == 'stream']
+        self.assertEqual(''.join(msg['content']['text'] for msg in streams), "['a', 'b', 'c']\n3\n")
+        updates = [msg for msg in output_msgs if msg['msg_type'] == 'update_display_data']
+        # One update per change of the width of the bar, and the final state
+        self.assertLessEqual(len(updates), 2 * 61)
+        self.assertTrue(updates[-1]['content']['data']['text/plain'].endswith('] 6000/6000'))
+
 
 if __name__ == '__main__':
     unittest.main()